@@ -0,0 +1,201 @@
+#ifndef _H_PHASES_
+#define _H_PHASES_
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sstm.h"
+#include "random.h"
+
+/*
+ * Phased workloads for the benchmarks: a script of steps, one per line,
+ *   <seconds> <read-all %> <update %> <zipf theta> <threads>
+ * ('#' starts a comment, 0 threads means all of them; bank uses the
+ * read-all share, ll the update share). The main thread walks the steps
+ * while a sampler thread writes the commit and abort rates to a csv
+ * every PHASES_SAMPLE_MS, so that the reaction of the runtime to a
+ * change of traffic can be seen.
+ */
+
+#define PHASES_MAX                      64
+#define PHASES_SAMPLE_MS                100
+#define PHASES_PARK_NS                  1000000
+
+typedef struct phase
+{
+  double duration;		/* seconds */
+  int read_all;			/* % of the transactions */
+  int update;			/* % of the operations */
+  double theta;			/* 0: uniform keys */
+  int threads;			/* running, the others are parked */
+  zipf_t zipf;
+} phase_t;
+
+extern volatile int work;	/* of the benchmark: 0 once the run is over */
+
+static phase_t phases[PHASES_MAX];
+static size_t n_phases;
+static volatile size_t phase_now;
+static volatile int sampling;
+
+/* the current step, NULL without a script */
+static inline phase_t*
+phase_current()
+{
+  return n_phases > 0 ? &phases[phase_now] : NULL;
+}
+
+/* reads the script at path, with keys in [0, n_keys); returns the
+   largest thread count of its steps, at least threads */
+static int
+phases_read(const char* path, uint64_t n_keys, int threads)
+{
+  FILE* f = fopen(path, "r");
+  char line[256];
+  int max = threads;
+  size_t i;
+
+  if (f == NULL)
+    {
+      perror(path);
+      exit(1);
+    }
+  while (fgets(line, sizeof(line), f) != NULL)
+    {
+      phase_t* p = &phases[n_phases];
+      char* comment = strchr(line, '#');
+      if (comment != NULL)
+	{
+	  *comment = '\0';
+	}
+      if (strspn(line, " \t\r\n") == strlen(line))
+	{
+	  continue;
+	}
+      if (n_phases == PHASES_MAX
+	  || sscanf(line, "%lf %d %d %lf %d", &p->duration, &p->read_all, &p->update, &p->theta, &p->threads) != 5
+	  || p->duration <= 0 || p->read_all < 0 || p->read_all > 100 || p->update < 0 || p->update > 100
+	  || p->theta < 0 || p->theta >= 1 || p->threads < 0)
+	{
+	  fprintf(stderr, "%s: bad step %zu: %s", path, n_phases + 1, line);
+	  exit(1);
+	}
+      if (p->theta > 0)
+	{
+	  zipf_init(&p->zipf, n_keys, p->theta);
+	}
+      if (p->threads > max)
+	{
+	  max = p->threads;
+	}
+      n_phases++;
+    }
+  fclose(f);
+  if (n_phases == 0)
+    {
+      fprintf(stderr, "%s: no steps\n", path);
+      exit(1);
+    }
+  for (i = 0; i < n_phases; i++)
+    {
+      if (phases[i].threads == 0)
+	{
+	  phases[i].threads = max;
+	}
+    }
+  return max;
+}
+
+/* a key for the current step, uniform in [0, n) if it is not skewed */
+static inline uint64_t
+phase_key(phase_t* p, uint64_t n)
+{
+  return p->theta > 0 ? zipf_key(&p->zipf) : fast_rand() % n;
+}
+
+/* parks the thread of index id while the current step runs fewer
+   threads; returns 0 once the run is over */
+static inline int
+phase_wait(int id)
+{
+  while (work && id >= phases[phase_now].threads)
+    {
+      struct timespec ts = { 0, PHASES_PARK_NS };
+      nanosleep(&ts, NULL);
+    }
+  return work;
+}
+
+static inline double
+phases_seconds(struct timespec* t0)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (t.tv_sec - t0->tv_sec) + (t.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/* one csv row per sample: the rates since the previous one */
+static void*
+phases_sampler(void* arg)
+{
+  FILE* f = (FILE*) arg;
+  struct timespec t0, period = { 0, PHASES_SAMPLE_MS * 1000000L };
+  size_t commits, aborts, last_commits, last_aborts;
+  double last = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  sstm_counters(&last_commits, &last_aborts);
+  fprintf(f, "time_s,phase,threads,commits_per_s,aborts_per_s,abort_pct\n");
+  while (sampling)
+    {
+      nanosleep(&period, NULL);
+      double now = phases_seconds(&t0);
+      sstm_counters(&commits, &aborts);
+      size_t dc = commits - last_commits, da = aborts - last_aborts;
+      fprintf(f, "%.3f,%zu,%d,%.0f,%.0f,%.2f\n", now, phase_now + 1, phases[phase_now].threads,
+	      dc / (now - last), da / (now - last), dc + da > 0 ? 100.0 * da / (dc + da) : 0.0);
+      last_commits = commits;
+      last_aborts = aborts;
+      last = now;
+    }
+  return NULL;
+}
+
+/* runs the steps one after the other, sampling into the csv at path;
+   returns the seconds they took. The worker threads must keep running
+   until it returns */
+static double
+phases_run(const char* path)
+{
+  FILE* f = fopen(path, "w");
+  pthread_t sampler;
+  struct timespec t0;
+  size_t i;
+
+  if (f == NULL)
+    {
+      perror(path);
+      exit(1);
+    }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  sampling = 1;
+  pthread_create(&sampler, NULL, phases_sampler, f);
+  for (i = 0; i < n_phases; i++)
+    {
+      struct timespec ts = { (time_t) phases[i].duration,
+	(long) ((phases[i].duration - (time_t) phases[i].duration) * 1e9) };
+      phase_now = i;
+      printf(" phase %zu: %.1fs, %d%% read-all, %d%% updates, theta %.2f, %d threads\n", i + 1,
+	     phases[i].duration, phases[i].read_all, phases[i].update, phases[i].theta, phases[i].threads);
+      nanosleep(&ts, NULL);
+    }
+  sampling = 0;
+  pthread_join(sampler, NULL);
+  fclose(f);
+  return phases_seconds(&t0);
+}
+
+#endif
@@ -2,6 +2,8 @@
 #define _H_RANDOM_
 
 #include <malloc.h>
+#include <math.h>
+#include <stdint.h>
 
 extern __thread unsigned long* seeds; 
 
@@ -63,4 +65,64 @@ fast_rand()
   return xorshf96(seeds, seeds + 1, seeds + 2);
 }
 
+/* Zipfian ranks in [0, n): rank k is drawn with a probability
+   proportional to 1 / (k + 1)^theta, for 0 < theta < 1 (Gray et al.,
+   "Quickly generating billion-record synthetic databases"). The sum over
+   the n ranks is computed once by zipf_init(), so that a draw only costs
+   a fast_rand() and a pow() */
+typedef struct zipf
+{
+  uint64_t n;
+  double theta;
+  double alpha;
+  double zetan;
+  double eta;
+  double half_pow;		/* 1 + 0.5^theta: the first two ranks */
+} zipf_t;
+
+static inline void
+zipf_init(zipf_t* z, uint64_t n, double theta)
+{
+  double zeta2 = 1 + pow(0.5, theta);
+  uint64_t i;
+
+  z->n = n;
+  z->theta = theta;
+  z->zetan = 0;
+  for (i = 1; i <= n; i++)
+    {
+      z->zetan += 1 / pow((double) i, theta);
+    }
+  z->alpha = 1 / (1 - theta);
+  z->eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / z->zetan);
+  z->half_pow = zeta2;
+}
+
+static inline uint64_t
+zipf_rand(zipf_t* z)
+{
+  double u = (fast_rand() >> 11) * (1.0 / (1ULL << 53));
+  double uz = u * z->zetan;
+  uint64_t rank;
+
+  if (uz < 1)
+    {
+      return 0;
+    }
+  if (uz < z->half_pow)
+    {
+      return 1;
+    }
+  rank = (uint64_t) (z->n * pow(z->eta * u - z->eta + 1, z->alpha));
+  return rank < z->n ? rank : z->n - 1;
+}
+
+/* a Zipfian key: the ranks are scattered over [0, n), so that the hot
+   keys are not the smallest ones (2654435761 is a prime: a bijection) */
+static inline uint64_t
+zipf_key(zipf_t* z)
+{
+  return (zipf_rand(z) * 2654435761ULL) % z->n;
+}
+
 #endif
@@ -8,6 +8,9 @@
 #include <stdarg.h>
 
 #include "sstm_alloc.h"
+#include "sstm_numa.h"
+#include "sstm_mv.h"
+#include "sstm_fc.h"
 
 #ifdef	__cplusplus
 extern "C" {
@@ -19,6 +22,12 @@ extern "C" {
 #include "lock_if.h"
 #include "atomic_ops_if.h"
 
+  /* the spin hint of mcs.h, which cannot be included from C++ */
+#if !defined(PAUSE_IN)
+#  define PAUSE_IN()			\
+  asm volatile ("pause");
+#endif
+
   /* **************************************************************************************************** */
   /* structures */
   /* **************************************************************************************************** */
@@ -26,7 +35,29 @@ extern "C" {
 
 #define LIST_INITIAL_SIZE 32
 #define LIST_EXPEND_FACTOR 4
-#define HASH_MODULO 1024
+#define HASH_MODULO 1024	/* write-set buckets, and initial locks per node */
+#define SSTM_STRIPE_SHIFT 4	/* one lock covers 16 bytes (initially) */
+#define SSTM_CACHE_LINE 64
+#define SSTM_MAX_THREADS 256
+
+  /* transaction modes */
+#define SSTM_MODE_OPTIMISTIC 0	/* validated reads, may abort */
+#define SSTM_MODE_SNAPSHOT 1	/* read-only, reads a multi-version snapshot */
+#define SSTM_MODE_SI 2		/* snapshot reads, write-write conflicts only */
+#define SSTM_MODE_VISIBLE 3	/* read-only, registered on the stripes it reads */
+#define SSTM_MODE_GLOBAL_LOCK 4	/* adaptive runtime: global lock backend */
+#define SSTM_MODE_NOREC 5	/* adaptive runtime: NOrec backend */
+
+  /* lock word layout:
+     locked:   (owner id << 1) | 1
+     unlocked: (((commit ts << SSTM_NODE_BITS) | commit node) << 1)
+  */
+#define LOCK_IS_LOCKED(lock) ((lock) & 1)
+#define LOCK_OWNER(lock) ((lock) >> 1)
+#define LOCK_OWNED_BY(id) (((id) << 1) | 1)
+#define LOCK_VERSION(ts, node) ((((size_t) (ts) << SSTM_NODE_BITS) | (node)) << 1)
+#define VERSION_TS(lock) ((lock) >> (SSTM_NODE_BITS + 1))
+#define VERSION_NODE(lock) (((lock) >> 1) & (SSTM_MAX_NODES - 1))
 
   typedef struct record_t
   {
@@ -49,20 +80,103 @@ extern "C" {
     size_t capacity;
   } array_list_t;
 
-  size_t hash_address(volatile uintptr_t* addr);
-
   void init_array_list(array_list_t* ls);
 
   void append_array_list(array_list_t* ls, volatile uintptr_t* address, uintptr_t value, size_t version);
 
   void free_array_list(array_list_t* ls);
 
+  /* the read set as parallel arrays: the stripe (index in the lock
+     table) and the lock word observed when reading it */
+  typedef struct read_set_t
+  {
+    uint32_t* stripes;
+    size_t* versions;
+    size_t size;
+    size_t capacity;
+  } read_set_t;
+
+  /* the lock set by stripe, to validate the stripes read before they
+     were locked: open addressing over the indices of the lock set,
+     filled with the locks acquired since the last lookup */
+  typedef struct owned_map_t
+  {
+    uint32_t* slots;		/* index in the lock set + 1, 0 if free */
+    size_t capacity;		/* a power of 2, at least twice size */
+    size_t size;		/* entries of the lock set indexed, a prefix */
+  } owned_map_t;
+
+  void init_read_set(read_set_t* rs);
+
+  void append_read_set(read_set_t* rs, size_t stripe, size_t version);
+
+  void free_read_set(read_set_t* rs);
+
   void free_linked_list(nodee_t* ls);
 
+#include "sstm_window.h"
+#include "sstm_adapt.h"
+
+#define SSTM_TABLE_OPEN 0
+#define SSTM_TABLE_CLOSED 1	/* being replaced: no new locks, reads go on */
+#define SSTM_TABLE_REPLACED 2	/* nothing read in it is protected anymore */
+
+  /* the locks, as n_nodes slices of size locks, each homed on its node.
+     A lock covers the addresses equal modulo size << shift */
+  typedef struct sstm_lock_table
+  {
+    volatile size_t* locks;
+    volatile uintptr_t* writers; /* per stripe, last address locked for (resizing only) */
+    volatile uint32_t* readers;	/* per stripe, visible readers */
+    size_t size;		/* locks per node, a power of 2 */
+    size_t shift;		/* log2 of the bytes covered by a lock */
+    size_t epoch;		/* tables replace each other in epoch order */
+    volatile size_t state;	/* SSTM_TABLE_*, see sstm_resize.c */
+    struct sstm_lock_table* next; /* replaced tables not freed yet */
+  } sstm_lock_table_t;
+
+#include "sstm_resize.h"
+#include "sstm_visible.h"
+#include "sstm_retry.h"
+#include "sstm_durable.h"
+#include "sstm_snapshot.h"
+#include "sstm_trace.h"
+
+  /* what waiting on a stripe locked by another thread gave */
+  typedef struct sstm_spin_stat
+  {
+    size_t waits;		/* times we found the stripe locked and waited */
+    size_t released;		/* waits that ended with the stripe unlocked */
+    size_t pauses;		/* pause iterations spent waiting */
+  } sstm_spin_stat_t;
+
   typedef struct sstm_metadata
   {
-    array_list_t read_set;
-    size_t read_snapshot_timestamp;
+    read_set_t read_set;
+    array_list_t lock_set;	/* held locks (address) with their version before locking */
+    owned_map_t owned;		/* ... by stripe, built by validation */
+    array_list_t undo_log;	/* write-through and global lock: overwritten values (address, value) */
+    array_list_t add_log;	/* TX_ADD: (address, delta) applied at commit */
+    size_t clock_view[SSTM_MAX_NODES]; /* last observed value of each node clock */
+    size_t node;		/* NUMA node the thread runs on */
+    size_t n_lazy;		/* writes buffered without locking the stripe */
+    int defer_aborts;		/* abort by flagging instead of siglongjmp */
+    int aborted;		/* reason of a deferred abort, 0 if none */
+    size_t mode;		/* SSTM_MODE_* of the running transaction */
+    volatile size_t commit_ts;	/* version being committed, SSTM_MV_PENDING or 0 */
+    sstm_mv_thread_t mv;
+    sstm_spin_stat_t* spin_stats; /* per stripe of the table spin_epoch, if spinning is enabled */
+    size_t spin_epoch;
+    size_t spin_size;		/* entries of spin_stats */
+    sstm_spin_stat_t spin_total; /* over all the tables */
+    sstm_adapt_thread_t adapt;
+    sstm_resize_thread_t resize;
+    sstm_visible_thread_t visible;
+    sstm_retry_thread_t retry;
+    sstm_durable_thread_t durable;
+    sstm_snapshot_thread_t snapshot;
+    sstm_trace_thread_t trace;
+    sstm_lock_table_t* lock_table; /* the table of the running transaction */
     nodee_t* write_set[HASH_MODULO]; // TODO put to NULL
 
     sigjmp_buf env;		/* Environment for setjmp/longjmp */
@@ -71,19 +185,118 @@ extern "C" {
     size_t n_aborts;
   } sstm_metadata_t;
 
-  typedef struct sstm_metadata_global
+  /* a transaction descriptor: the metadata of the thread running it */
+  typedef sstm_metadata_t* sstm_tx_t;
+
+  /* one commit clock per node, each on its own cache line */
+  typedef struct sstm_node_clock
   {
     volatile size_t clock;
-    volatile size_t locks[HASH_MODULO];
+    uint8_t padding[SSTM_CACHE_LINE - sizeof(size_t)];
+  } sstm_node_clock_t;
+
+  typedef struct sstm_metadata_global
+  {
+    sstm_node_clock_t clocks[SSTM_MAX_NODES];
+    sstm_lock_table_t* volatile lock_table; /* taken by each transaction as it starts */
+    size_t n_nodes;
+    sstm_numa_region_t regions[SSTM_NUMA_MAX_REGIONS];
+    size_t n_regions;
+    volatile size_t n_threads;
+    volatile size_t n_active;	/* started and not yet stopped */
+    int write_through;		/* stores write in place with an undo log */
+    size_t spin_budget;		/* pauses to wait for a locked stripe, 0 aborts at once */
+    sstm_spin_stat_t* spin_stats; /* per stripe of the newest table the stopped threads used */
+    size_t spin_epoch;
+    size_t spin_size;
+    sstm_spin_stat_t spin_total;
+    ptlock_t spin_lock;		/* stopping threads add their counts one at a time */
+    sstm_adapt_global_t adapt;	/* backend switching (sstm_adapt_enable) */
+    sstm_resize_global_t resize; /* lock table resizing (sstm_resize_enable) */
+    volatile size_t n_visible;	/* running visible readers */
+    volatile size_t n_parked;	/* threads blocked in TX_RETRY */
+    volatile size_t n_parked_any; /* ... waiting for any commit */
+    volatile uint32_t retry_seq; /* futex word they wait on, bumped by the commits that see them */
+    size_t n_retries;		/* TX_RETRY of the stopped threads */
+    sstm_durable_global_t durable; /* redo log (sstm_durable_enable) */
+    sstm_snapshot_global_t snapshot; /* online copies (sstm_snapshot_region) */
+    struct sstm_metadata* threads[SSTM_MAX_THREADS]; /* descriptors by id */
+    int mv_enabled;		/* writers keep old versions (sstm_mv_enable) */
+    sstm_mv_chain_t* mv_chains;	/* per stripe */
+    sstm_mv_batch_t* volatile mv_orphans; /* batches of stopped threads */
 
     size_t n_commits;
     size_t n_aborts;
   } sstm_metadata_global_t;
 
 
-extern __thread sstm_metadata_t sstm_meta;
+/* initial-exec for libsstm.a: the descriptor is found at a fixed offset
+   instead of via __tls_get_addr. libsstm.so, which may be dlopened, is
+   built with -DSSTM_TLS_MODEL= (the default model of -fPIC) */
+#ifndef SSTM_TLS_MODEL
+#define SSTM_TLS_MODEL __attribute__((tls_model("initial-exec")))
+#endif
+
+extern __thread sstm_metadata_t sstm_meta SSTM_TLS_MODEL;
 extern sstm_metadata_global_t sstm_meta_global;
 
+  /* bucket of addr in the write set */
+  static inline size_t
+  hash_address(volatile uintptr_t* addr)
+  {
+    return ((size_t) addr >> SSTM_STRIPE_SHIFT) % HASH_MODULO;
+  }
+
+  /* the node whose lock-table slice covers addr: a registered region,
+     otherwise pages are interleaved over the nodes */
+  static inline size_t
+  sstm_node_of(volatile uintptr_t* addr)
+  {
+    if (sstm_meta_global.n_nodes == 1)
+      {
+	return 0;
+      }
+
+    size_t i;
+    for (i = 0; i < sstm_meta_global.n_regions; i++)
+      {
+	sstm_numa_region_t* r = &sstm_meta_global.regions[i];
+	if ((uintptr_t) addr >= r->start && (uintptr_t) addr < r->end)
+	  {
+	    return r->node;
+	  }
+      }
+    return ((uintptr_t) addr >> SSTM_NUMA_PAGE_SHIFT) % sstm_meta_global.n_nodes;
+  }
+
+  /* index of the lock of addr in table */
+  static inline size_t
+  sstm_stripe_in(const sstm_lock_table_t* table, volatile uintptr_t* addr)
+  {
+    return sstm_node_of(addr) * table->size
+      + (((uintptr_t) addr >> table->shift) & (table->size - 1));
+  }
+
+  /* the same in the current table */
+  static inline size_t
+  sstm_stripe_of(volatile uintptr_t* addr)
+  {
+    return sstm_stripe_in(sstm_meta_global.lock_table, addr);
+  }
+
+  static inline volatile size_t*
+  sstm_lock_of(volatile uintptr_t* addr)
+  {
+    return &sstm_meta_global.lock_table->locks[sstm_stripe_of(addr)];
+  }
+
+  /* first address of the stripe after the one of a */
+  static inline uintptr_t
+  sstm_stripe_next(const sstm_lock_table_t* table, uintptr_t a)
+  {
+    return ((a >> table->shift) + 1) << table->shift;
+  }
+
 
   /* **************************************************************************************************** */
   /* TM start/stop macros macros */
@@ -114,11 +327,37 @@ extern sstm_metadata_global_t sstm_meta_global;
     short int reason;					\
     if ((reason = sigsetjmp(sstm_meta.env, 0)) != 0)	\
       {							\
+	SSTM_TRACE(&sstm_meta, SSTM_TRACE_ABORT, reason, 0, 0); \
 	sstm_tx_cleanup();				\
 	PRINTD("|| restarting due to %d\n", reason);	\
       }							\
+    SSTM_TRACE(&sstm_meta, SSTM_TRACE_BEGIN, 0, 0, 0);	\
+    if (sstm_meta_global.adapt.enabled)			\
+      {							\
+	sstm_adapt_begin(&sstm_meta);			\
+      }							\
   }
 
+  /* a read-only transaction that reads the snapshot taken when it starts
+     without validation; needs sstm_mv_enable() */
+#define TX_START_RO()				\
+  TX_START();					\
+  sstm_mv_begin(&sstm_meta, SSTM_MODE_SNAPSHOT);
+
+  /* snapshot isolation: reads as TX_START_RO(), writes are allowed and
+     the transaction only aborts if another one committed to a stripe it
+     writes after its snapshot. Write skew is possible. */
+#define TX_START_SI()				\
+  TX_START();					\
+  sstm_mv_begin(&sstm_meta, SSTM_MODE_SI);
+
+  /* a read-only transaction whose reads are visible to writers: they
+     wait for it or abort, so it commits without validation. For long
+     readers that invisible reads would leave starved */
+#define TX_START_VISIBLE()			\
+  TX_START();					\
+  sstm_visible_begin(&sstm_meta);
+
 #define TX_COMMIT()				\
   sstm_tx_commit();				\
   PRINTD("|| commited tx (%zu)\n", sstm_meta.n_commits);     
@@ -127,12 +366,87 @@ extern sstm_metadata_global_t sstm_meta_global;
   PRINTD("|| aborting tx (%d)\n", reason);	\
   siglongjmp(sstm_meta.env, reason);
 
+  /* aborts, blocks until a commit writes a stripe the transaction has
+     read (any commit in the modes that do not track stripes), and
+     restarts: e.g. a consumer that found its queue empty. Not counted as
+     an abort */
+#define TX_RETRY()				\
+  sstm_tx_retry(&sstm_meta);
+
 #define TX_LOAD(addr)				\
   sstm_tx_load((volatile uintptr_t*) addr)
 
 #define TX_STORE(addr, val)			\
   sstm_tx_store((volatile uintptr_t*) addr, (uintptr_t) val)
 
+  /* copy len bytes (a multiple of the word size) from/to transactional memory */
+#define TX_LOAD_RANGE(dst, src, len)		\
+  sstm_tx_load_range((void*) (dst), (volatile void*) (src), len)
+
+#define TX_STORE_RANGE(dst, src, len)		\
+  sstm_tx_store_range((volatile void*) (dst), (const void*) (src), len)
+
+  /* adds delta to the word at addr at commit, without reading it: adds
+     to the same word commute. A load of the word in the same transaction
+     does not see the delta */
+#define TX_ADD(addr, delta)			\
+  sstm_tx_add((volatile uintptr_t*) addr, (intptr_t) delta)
+
+  /* drop an earlier load from the read set, e.g. the links an elastic
+     traversal has moved past */
+#define TX_RELEASE(addr)			\
+  sstm_tx_release((volatile uintptr_t*) addr)
+
+  /* descriptor-passing variants: the thread-local descriptor is looked up
+     once by TX_BEGIN() and then passed explicitly, e.g.
+       sstm_tx_t tx = TX_BEGIN();
+       v = TX_LOAD_D(tx, addr);
+       TX_COMMIT_D(tx);
+  */
+#define TX_BEGIN()					\
+  ({ sstm_tx_t __tx = &sstm_meta;			\
+    short int __reason;					\
+    if ((__reason = sigsetjmp(__tx->env, 0)) != 0)	\
+      {							\
+	SSTM_TRACE(__tx, SSTM_TRACE_ABORT, __reason, 0, 0); \
+	sstm_tx_cleanup_d(__tx);			\
+	PRINTD("|| restarting due to %d\n", __reason);	\
+      }							\
+    SSTM_TRACE(__tx, SSTM_TRACE_BEGIN, 0, 0, 0);		\
+    if (sstm_meta_global.adapt.enabled)			\
+      {							\
+	sstm_adapt_begin(__tx);				\
+      }							\
+    __tx; })
+
+#define TX_COMMIT_D(tx)				\
+  sstm_tx_commit_d(tx);
+
+#define TX_ABORT_D(tx, reason)			\
+  PRINTD("|| aborting tx (%d)\n", reason);	\
+  siglongjmp((tx)->env, reason);
+
+#define TX_RETRY_D(tx)				\
+  sstm_tx_retry(tx);
+
+#define TX_LOAD_D(tx, addr)			\
+  sstm_tx_load_d(tx, (volatile uintptr_t*) addr)
+
+#define TX_STORE_D(tx, addr, val)				\
+  sstm_tx_store_d(tx, (volatile uintptr_t*) addr, (uintptr_t) val)
+
+#define TX_LOAD_RANGE_D(tx, dst, src, len)				\
+  sstm_tx_load_range_d(tx, (void*) (dst), (volatile void*) (src), len)
+
+#define TX_STORE_RANGE_D(tx, dst, src, len)				\
+  sstm_tx_store_range_d(tx, (volatile void*) (dst), (const void*) (src), len)
+
+#define TX_ADD_D(tx, addr, delta)				\
+  sstm_tx_add_d(tx, (volatile uintptr_t*) addr, (intptr_t) delta)
+
+#define TX_RELEASE_D(tx, addr)				\
+  sstm_tx_release_d(tx, (volatile uintptr_t*) addr)
+
 #define TX_MALLOC(size)				\
   sstm_tx_alloc(size)
 
@@ -149,10 +463,26 @@ extern sstm_metadata_global_t sstm_meta_global;
      (e.g., deallocates the locks that the system uses ) 
   */
   extern void sstm_stop();
+  /* stores write in place and keep an undo log, instead of buffering:
+     cheaper read-after-write and commit, costlier abort. Call after
+     sstm_start(), before the threads start; not with sstm_mv_enable()
+  */
+  extern void sstm_write_through_enable();
+  /* waits up to budget pause iterations for a stripe locked by another
+     thread to be released before aborting, and counts per stripe how
+     often that pays off. Call after sstm_start(), before the threads start
+  */
+  extern void sstm_spin_enable(size_t budget);
+  /* prints the spin statistics of the stopped threads; before sstm_stop() */
+  extern void sstm_print_spin_stats();
   /* prints the TM system stats
 ****** DO NOT TOUCH *********
 */
   extern void sstm_print_stats(double dur_s);
+  /* commits and aborts so far, of the running and of the stopped
+     threads, read without synchronization: for monitoring while the
+     threads run, which must not stop meanwhile */
+  extern void sstm_counters(size_t* commits, size_t* aborts);
   /* initializes thread local data
      (e.g., allocate a thread local counter)
   */
@@ -162,12 +492,24 @@ extern sstm_metadata_global_t sstm_meta_global;
      ****** DO NOT CHANGE THE EXISTING CODE*********   
      */
   extern void sstm_thread_stop();
-  /* transactionally reads the value of addr
+  /* transactionally reads the value of addr, when the inline fast path
+     of sstm_tx_load_d (below) does not apply
    */
-  extern inline uintptr_t sstm_tx_load(volatile uintptr_t* addr);
+  extern uintptr_t sstm_tx_load_slow(sstm_tx_t tx, volatile uintptr_t* addr);
   /* transactionally writes val in addr
    */
-  extern inline void sstm_tx_store(volatile uintptr_t* addr, uintptr_t val);
+  extern void sstm_tx_store(volatile uintptr_t* addr, uintptr_t val);
+  /* transactionally copies len bytes from src to dst, validating each
+     covered stripe once
+  */
+  extern void sstm_tx_load_range(void* dst, volatile void* src, size_t len);
+  /* transactionally writes len bytes of src in dst, locking each covered
+     stripe once
+  */
+  extern void sstm_tx_store_range(volatile void* dst, const void* src, size_t len);
+  /* adds delta to addr at commit, locking its stripe only then
+  */
+  extern void sstm_tx_add(volatile uintptr_t* addr, intptr_t delta);
   /* cleaning up in case of an abort 
      (e.g., flush the read or write logs)
   */
@@ -178,9 +520,136 @@ extern sstm_metadata_global_t sstm_meta_global;
   */
   extern void sstm_tx_commit();
 
-  size_t validate();
+  /* the same operations on an explicit descriptor (see TX_BEGIN) */
+  extern void sstm_tx_store_d(sstm_tx_t tx, volatile uintptr_t* addr, uintptr_t val);
+  extern void sstm_tx_load_range_d(sstm_tx_t tx, void* dst, volatile void* src, size_t len);
+  extern void sstm_tx_store_range_d(sstm_tx_t tx, volatile void* dst, const void* src, size_t len);
+  extern void sstm_tx_add_d(sstm_tx_t tx, volatile uintptr_t* addr, intptr_t delta);
+  extern void sstm_tx_cleanup_d(sstm_tx_t tx);
+  extern void sstm_tx_commit_d(sstm_tx_t tx);
+
+  /* lazy locking: the store only buffers the value, the stripe is
+     locked at commit. Loads must then go through sstm_tx_load_lazy_d
+  */
+  extern void sstm_tx_store_lazy_d(sstm_tx_t tx, volatile uintptr_t* addr, uintptr_t val);
+  /* aborts tx: siglongjmp to its start, or if tx->defer_aborts is set,
+     release its locks and set tx->aborted; the operations of the
+     transaction are then no-ops until sstm_tx_cleanup_d()
+  */
+  extern void sstm_tx_abort(sstm_tx_t tx, int reason);
+
+  /* checks that every stripe of the read set still has the version we read
+   */
+  size_t validate(sstm_tx_t tx);
+
+  /* picks the validation kernel supported by the cpu */
+  void select_validate_kernel();
+
+  void release_locks(sstm_tx_t tx, size_t version);
 
-  void clear_transaction();
+  void clear_transaction(sstm_tx_t tx);
+
+  /* a lock table with every stripe unlocked at version 0, and its release */
+  sstm_lock_table_t* sstm_lock_table_new(size_t size, size_t shift);
+  void sstm_lock_table_free(sstm_lock_table_t* table);
+
+  /* adds addr to the write set without locking its stripe */
+  void sstm_buffer_write(sstm_tx_t tx, volatile uintptr_t* addr, uintptr_t val);
+
+  /* **************************************************************************************************** */
+  /* inline fast paths */
+  /* **************************************************************************************************** */
+
+  /* transactionally reads the value of addr, within tx.
+     Inlined for the common case: the stripe is unlocked, its version is
+     not newer than our view of the clocks and the read set has room.
+     Snapshot transactions always take the slow path.
+     Everything else goes through sstm_tx_load_slow().
+   */
+  static inline uintptr_t
+  sstm_tx_load_d(sstm_tx_t tx, volatile uintptr_t* addr)
+  {
+    size_t stripe = sstm_stripe_in(tx->lock_table, addr);
+    volatile size_t* lock = &tx->lock_table->locks[stripe];
+    size_t before = *lock;
+    read_set_t* rs = &tx->read_set;
+
+    if (!LOCK_IS_LOCKED(before)
+	&& tx->mode == SSTM_MODE_OPTIMISTIC
+	&& VERSION_TS(before) <= tx->clock_view[VERSION_NODE(before)]
+	&& rs->size < rs->capacity)
+      {
+	uintptr_t value = *addr;
+	if (*lock == before && tx->lock_table->state != SSTM_TABLE_REPLACED)
+	  {
+	    rs->stripes[rs->size] = stripe;
+	    rs->versions[rs->size] = before;
+	    rs->size++;
+	    return value;
+	  }
+      }
+    return sstm_tx_load_slow(tx, addr);
+  }
+
+  /* a load that first looks for a value buffered by a lazy store */
+  static inline uintptr_t
+  sstm_tx_load_lazy_d(sstm_tx_t tx, volatile uintptr_t* addr)
+  {
+    nodee_t* curr = tx->write_set[hash_address(addr)];
+    while (curr != NULL)
+      {
+	if (curr->record.address == addr)
+	  {
+	    return curr->record.value;
+	  }
+	curr = curr->next;
+      }
+    return sstm_tx_load_d(tx, addr);
+  }
+
+  static inline uintptr_t
+  sstm_tx_load(volatile uintptr_t* addr)
+  {
+    return sstm_tx_load_d(&sstm_meta, addr);
+  }
+
+  /* early release: the last read-set entry of the stripe of addr is
+     dropped, so the transaction is no longer serializable with respect
+     to that load. Every load of the stripe has its own entry: the
+     stripe stays validated while another load of it is not released.
+     Elastic traversals release the links they have moved past: the
+     entry is then one of the last few, hence the backward scan.
+     TX_LOAD_RANGE counts as one load of each stripe it covers.
+   */
+  static inline void
+  sstm_tx_release_d(sstm_tx_t tx, volatile uintptr_t* addr)
+  {
+    read_set_t* rs = &tx->read_set;
+    size_t stripe = sstm_stripe_in(tx->lock_table, addr);
+    size_t i = rs->size;
+
+    if (tx->mode == SSTM_MODE_VISIBLE) // the stripes are kept until the end
+      {
+	return;
+      }
+
+    while (i-- > 0)
+      {
+	if (rs->stripes[i] == stripe)
+	  {
+	    rs->size--;
+	    rs->stripes[i] = rs->stripes[rs->size];
+	    rs->versions[i] = rs->versions[rs->size];
+	    return;
+	  }
+      }
+  }
+
+  static inline void
+  sstm_tx_release(volatile uintptr_t* addr)
+  {
+    sstm_tx_release_d(&sstm_meta, addr);
+  }
 
   /* **************************************************************************************************** */
   /* help functions */
@@ -0,0 +1,245 @@
+#ifndef _SSTM_HPP_
+#define	_SSTM_HPP_
+
+/* C++ layer over sstm.h (C++17).
+ *
+ *   sstm::tm_var<int64_t> counter;
+ *   sstm::atomically(sstm::eager_policy(), [&](auto& tx) {
+ *       std::optional<int64_t> v = tx.load(counter);
+ *       if (!v || !tx.store(counter, *v + 1))
+ *         return sstm::status::aborted;
+ *       return sstm::status::commit;
+ *     });
+ *
+ * The policy is a type, so the choice of load/store functions and of
+ * how the transaction starts is made at compile time. Aborts are deferred
+ * in the C library (see sstm_tx_abort): the operation that aborted
+ * returns an empty optional or false, and the body returns
+ * status::aborted, so it never goes on with an unvalidated value, no
+ * siglongjmp crosses C++ frames, and destructors in the body run
+ * normally. No exception is thrown or caught.
+ */
+
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "sstm.h"
+
+namespace sstm
+{
+  /* locking policies */
+  struct eager {};		/* stripes are locked by the first store */
+  struct lazy {};		/* stores are buffered, stripes locked at commit */
+  struct read_only {};		/* no stores: does not compile */
+
+  /* backends: how a transaction starts, as TX_START, TX_START_SI,
+     TX_START_RO and TX_START_VISIBLE */
+  struct optimistic		/* the stripe-based STM of sstm.c */
+  {
+    static void begin(sstm_tx_t) {}
+  };
+  struct snapshot_isolation	/* snapshot reads, write-write conflicts only */
+  {
+    static void begin(sstm_tx_t tx) { sstm_mv_begin(tx, SSTM_MODE_SI); }
+  };
+  struct snapshot		/* read-only, not validated; needs sstm_mv_enable() */
+  {
+    static void begin(sstm_tx_t tx) { sstm_mv_begin(tx, SSTM_MODE_SNAPSHOT); }
+  };
+  struct visible		/* read-only, writers wait for it */
+  {
+    static void begin(sstm_tx_t tx) { sstm_visible_begin(tx); }
+  };
+
+  template <typename Locking = eager, typename Backend = optimistic>
+  struct policy
+  {
+    static_assert(std::is_same<Locking, read_only>::value
+		  || !(std::is_same<Backend, snapshot>::value || std::is_same<Backend, visible>::value),
+		  "snapshot and visible transactions are read-only");
+    static_assert(!std::is_same<Locking, lazy>::value || std::is_same<Backend, optimistic>::value,
+		  "lazy locking needs the optimistic backend");
+
+    typedef Locking locking;
+    typedef Backend backend;
+  };
+
+  typedef policy<eager> eager_policy;
+  typedef policy<lazy> lazy_policy;
+  typedef policy<read_only> read_only_policy;
+  typedef policy<eager, snapshot_isolation> si_policy;
+  typedef policy<read_only, snapshot> snapshot_policy;
+  typedef policy<read_only, visible> visible_policy;
+
+  /* load and store functions of a locking policy; sstm_tx_load_d and
+     sstm_tx_store_d follow the mode the backend started */
+  template <typename Locking>
+  struct ops;
+
+  template <>
+  struct ops<eager>
+  {
+    static uintptr_t load(sstm_tx_t tx, volatile uintptr_t* a) { return sstm_tx_load_d(tx, a); }
+    static void store(sstm_tx_t tx, volatile uintptr_t* a, uintptr_t v) { sstm_tx_store_d(tx, a, v); }
+  };
+
+  template <>
+  struct ops<lazy>
+  {
+    static uintptr_t load(sstm_tx_t tx, volatile uintptr_t* a) { return sstm_tx_load_lazy_d(tx, a); }
+    static void store(sstm_tx_t tx, volatile uintptr_t* a, uintptr_t v) { sstm_tx_store_lazy_d(tx, a, v); }
+  };
+
+  template <>
+  struct ops<read_only>
+  {
+    static uintptr_t load(sstm_tx_t tx, volatile uintptr_t* a) { return sstm_tx_load_d(tx, a); }
+  };
+
+  /* what the body of atomically() returns, and atomically() after it */
+  enum class status
+  {
+    commit,			/* commit, or run the body again if that fails */
+    aborted,			/* an operation failed: run the body again */
+    cancel			/* drop the writes and return, without retrying */
+  };
+
+  constexpr int cancel_reason = 41;	/* abort reason of status::cancel */
+
+  /* word-sized values go through the STM bit for bit */
+  template <typename T>
+  struct word
+  {
+    static_assert(sizeof(T) <= sizeof(uintptr_t), "transactional values are at most a word");
+    static_assert(std::is_trivially_copyable<T>::value, "transactional values are copied bitwise");
+
+    static uintptr_t to(T v) { uintptr_t w = 0; std::memcpy(&w, &v, sizeof(T)); return w; }
+    static T from(uintptr_t w) { T v; std::memcpy(&v, &w, sizeof(T)); return v; }
+  };
+
+  /* a typed pointer to a word of transactional memory, e.g. a field of a
+     structure shared with C code: tx_ptr<int64_t>(&acc->balance) */
+  template <typename T>
+  class tx_ptr
+  {
+  public:
+    explicit tx_ptr(T* p) : p_(p) {}
+    volatile uintptr_t* word_address() const { return (volatile uintptr_t*) p_; }
+    T* get() const { return p_; }
+  private:
+    T* p_;
+  };
+
+  /* a transactional variable, padded to a word */
+  template <typename T>
+  class tm_var
+  {
+  public:
+    tm_var() : w_(0) {}
+    explicit tm_var(T v) : w_(word<T>::to(v)) {}
+    /* access outside of any transaction (initialization, checks) */
+    T unsafe_load() const { return word<T>::from(w_); }
+    void unsafe_store(T v) { w_ = word<T>::to(v); }
+    volatile uintptr_t* word_address() { return &w_; }
+  private:
+    volatile uintptr_t w_;
+  };
+
+  /* the transaction handed to the body of atomically() */
+  template <typename Policy>
+  class transaction
+  {
+    typedef ops<typename Policy::locking> ops_t;
+
+  public:
+    explicit transaction(sstm_tx_t tx) : tx_(tx) {}
+
+    /* empty once the transaction aborted: the body returns status::aborted */
+    template <typename T> [[nodiscard]] std::optional<T> load(tx_ptr<T> p) { return loaded<T>(ops_t::load(tx_, p.word_address())); }
+    template <typename T> [[nodiscard]] std::optional<T> load(tm_var<T>& v) { return loaded<T>(ops_t::load(tx_, v.word_address())); }
+
+    /* false once the transaction aborted: the body returns status::aborted */
+    template <typename T> [[nodiscard]] bool store(tx_ptr<T> p, T v)
+    {
+      static_assert(!std::is_same<typename Policy::locking, read_only>::value, "store in a read-only transaction");
+      ops_t::store(tx_, p.word_address(), word<T>::to(v));
+      return !tx_->aborted;
+    }
+    template <typename T> [[nodiscard]] bool store(tm_var<T>& var, T v)
+    {
+      static_assert(!std::is_same<typename Policy::locking, read_only>::value, "store in a read-only transaction");
+      ops_t::store(tx_, var.word_address(), word<T>::to(v));
+      return !tx_->aborted;
+    }
+
+    /* aborts; atomically() blocks until a stripe read so far is written,
+       then runs the body again: return tx.retry(); */
+    [[nodiscard]] status retry()
+    {
+      sstm_tx_retry(tx_);
+      return status::aborted;
+    }
+
+    sstm_tx_t descriptor() const { return tx_; }
+
+  private:
+    template <typename T> std::optional<T> loaded(uintptr_t w)
+    {
+      if (tx_->aborted)
+	{
+	  return std::nullopt;
+	}
+      return word<T>::from(w);
+    }
+
+    sstm_tx_t tx_;
+  };
+
+  /* runs body(tx) as a transaction until it commits or the body returns
+     status::cancel, and returns status::commit or status::cancel. Results
+     go out through the captures of the body. The thread must have called
+     TM_THREAD_START(). */
+  template <typename Policy, typename F>
+  status atomically(Policy, F&& body)
+  {
+    static_assert(std::is_same<decltype(body(std::declval<transaction<Policy>&>())), status>::value,
+		  "the body returns an sstm::status");
+
+    sstm_tx_t tx = &sstm_meta;
+    tx->defer_aborts = 1;
+    // sstm_adapt_enable() is called before the threads start
+    const bool adaptive = sstm_meta_global.adapt.enabled;
+
+    while (true)
+      {
+	if (adaptive)
+	  {
+	    sstm_adapt_begin(tx);
+	  }
+	Policy::backend::begin(tx);
+	transaction<Policy> t(tx);
+	status s = body(t);
+	if (s == status::commit && !tx->aborted)
+	  {
+	    sstm_tx_commit_d(tx);
+	    if (!tx->aborted)
+	      {
+		tx->defer_aborts = 0;
+		return status::commit;
+	      }
+	  }
+	else if (s == status::cancel)
+	  {
+	    sstm_tx_abort(tx, cancel_reason);
+	    sstm_tx_cleanup_d(tx);
+	    tx->defer_aborts = 0;
+	    return status::cancel;
+	  }
+	sstm_tx_cleanup_d(tx);
+      }
+  }
+}
+
+#endif	/* _SSTM_HPP_ */
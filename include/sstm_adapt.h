@@ -0,0 +1,71 @@
+#ifndef _SSTM_ADAPT_H_
+#define	_SSTM_ADAPT_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* needs ptlock_t and sstm_window_t: included by sstm.h */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+  /* backends */
+#define SSTM_BACKEND_OPTIMISTIC 0	/* stripe locks, read set validation (sstm.c) */
+#define SSTM_BACKEND_GLOBAL_LOCK 1	/* one lock around every transaction */
+#define SSTM_BACKEND_NOREC 2		/* one sequence lock, value-based validation */
+#define SSTM_BACKENDS 3
+
+#define SSTM_ADAPT_FLUSH 256	/* commits between two flushes of the thread counters */
+#define SSTM_ADAPT_WINDOW 16384	/* commits between two decisions */
+#define SSTM_ADAPT_STAY 4	/* windows on the global lock before trying again */
+#define SSTM_ADAPT_HIGH 60	/* abort %: global lock */
+#define SSTM_ADAPT_MEDIUM 25	/* abort %, with mostly updates: NOrec */
+
+  typedef struct sstm_adapt_thread
+  {
+    volatile size_t in_tx;	/* between sstm_adapt_begin and the commit or abort */
+    size_t snapshot;		/* NOrec: even sequence number the reads are valid at */
+    array_list_t value_log;	/* NOrec: (address, value) of the reads */
+    size_t commits, aborts, ro_commits; /* since the last flush */
+    size_t flushed_aborts;	/* n_aborts at the last flush */
+  } sstm_adapt_thread_t;
+
+  typedef struct sstm_adapt_global
+  {
+    int enabled;
+    volatile size_t backend;	/* SSTM_BACKEND_* all transactions use */
+    volatile size_t switching;	/* new transactions wait while set */
+    sstm_window_t window;	/* commits, aborts, read-only commits; decides and switches */
+    ptlock_t gl_lock;		/* the global lock backend */
+    volatile size_t seq;	/* the NOrec sequence lock, odd while writing back */
+    size_t stay;		/* windows left on the global lock */
+    size_t n_switches;
+    size_t windows[SSTM_BACKENDS]; /* windows run on each backend */
+  } sstm_adapt_global_t;
+
+  struct sstm_metadata;
+
+  /* lets the runtime pick the backend from windowed commit and abort
+     statistics. Call after sstm_start(), before the threads start; not
+     with sstm_mv_enable() or sstm_write_through_enable() */
+  void sstm_adapt_enable(size_t backend);
+  void sstm_adapt_print_stats();
+
+  /* called by TX_START and TX_BEGIN when enabled: waits while the
+     backend is switching, then starts the transaction on it */
+  void sstm_adapt_begin(struct sstm_metadata* tx);
+  /* the transaction left the backend, committed (read-only or not) or aborted */
+  void sstm_adapt_commit_end(struct sstm_metadata* tx, size_t read_only);
+  void sstm_adapt_abort_end(struct sstm_metadata* tx);
+
+  /* operations of the global-lock and NOrec backends */
+  uintptr_t sstm_adapt_load(struct sstm_metadata* tx, volatile uintptr_t* addr);
+  void sstm_adapt_store(struct sstm_metadata* tx, volatile uintptr_t* addr, uintptr_t val);
+  void sstm_adapt_commit(struct sstm_metadata* tx);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_ADAPT_H_ */
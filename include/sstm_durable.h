@@ -0,0 +1,90 @@
+#ifndef _SSTM_DURABLE_H_
+#define	_SSTM_DURABLE_H_
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_DURABLE_LOG_SIZE (64 << 20) /* bytes of the redo log; a checkpoint is taken when half is used */
+#define SSTM_DURABLE_MAX_REGIONS 16
+#define SSTM_DURABLE_WINDOW_US 100 /* default wait of the flusher for more commits to join a group */
+#define SSTM_DURABLE_IDLE_MS 10	/* sleep of an idle flusher between two checks */
+
+  /* a memory region whose content survives restarts */
+  typedef struct sstm_durable_region
+  {
+    uintptr_t start;
+    size_t len;
+  } sstm_durable_region_t;
+
+  /* a written word of a durable region, and where it goes in the log */
+  typedef struct sstm_durable_word
+  {
+    volatile uintptr_t* address;
+    uint64_t key;		/* region << 48 | word offset */
+  } sstm_durable_word_t;
+
+  typedef struct sstm_durable_thread
+  {
+    sstm_durable_word_t* words;	/* of the committing transaction */
+    size_t n_words;
+    size_t capacity;
+    size_t lsn;			/* start of its reserved log entry */
+    size_t end;			/* end of the last entry we must wait for, 0 if none */
+  } sstm_durable_thread_t;
+
+  typedef struct sstm_durable_global
+  {
+    int enabled;
+    char* path;			/* the redo log; the checkpoint is path.ckpt */
+    char* ckpt_path;
+    char* tmp_path;
+    size_t window_us;
+    sstm_durable_region_t regions[SSTM_DURABLE_MAX_REGIONS];
+    size_t n_regions;
+    int fd;
+    uint8_t* ring;		/* the log, mapped: offset lsn % capacity */
+    size_t capacity;
+    uint64_t incarnation;	/* entries of older runs do not checksum */
+    volatile size_t tail;	/* reserved up to */
+    volatile size_t done;	/* complete and flushed up to */
+    volatile size_t ckpt_lsn;	/* replay starts here: the log before is free */
+    volatile uint32_t idle;	/* futex word: the flusher sleeps */
+    volatile uint32_t flushed;	/* futex word: bumped at each flush */
+    volatile int stop;
+    pthread_t flusher;
+    size_t n_recovered, n_flushes, n_logged, n_checkpoints;
+  } sstm_durable_global_t;
+
+  struct sstm_metadata;
+
+  /* makes the regions declared with sstm_durable_region() durable, with a
+     redo log in path. Commits wait until their writes are flushed, in
+     groups formed over window_us. Call before sstm_start(), which
+     recovers the regions from the log; not with sstm_adapt_enable() */
+  void sstm_durable_enable(const char* path, size_t window_us);
+  /* declares that [base, base + len) is durable. Regions must be declared
+     in the same order, with the same lengths, by every run */
+  void sstm_durable_region(void* base, size_t len);
+  void sstm_durable_print_stats();
+
+  /* at sstm_start()/sstm_stop() */
+  void sstm_durable_start();
+  void sstm_durable_stop();
+  /* reserves the log entry of a validated writer, before its write-back */
+  void sstm_durable_reserve(struct sstm_metadata* tx);
+  /* fills it, after the write-back and before the locks are released */
+  void sstm_durable_append(struct sstm_metadata* tx);
+  /* waits for the entry to be flushed */
+  void sstm_durable_wait(struct sstm_metadata* tx);
+  void sstm_durable_thread_stop(struct sstm_metadata* tx);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_DURABLE_H_ */
@@ -0,0 +1,31 @@
+#ifndef _SSTM_FC_H_
+#define	_SSTM_FC_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_FC_GROUPS 16	/* combining groups, each with its own combiner lock */
+#define SSTM_FC_MAX_BATCH 64	/* closures run by a combiner in one transaction */
+#define SSTM_FC_YIELD 1024	/* pauses before a waiter yields the cpu */
+
+  /* a transaction body: uses TX_LOAD/TX_STORE of the calling thread and
+     may run several times, so it must not have other side effects */
+  typedef uintptr_t (*sstm_fc_fn)(void* arg);
+
+  /* runs fn(arg) as a transaction, delegated to the combiner of group:
+     closures of a group are executed serially, in batches, so they
+     never conflict with each other. Returns the result of fn. Not to be
+     called inside a transaction. */
+  uintptr_t sstm_fc_execute(size_t group, sstm_fc_fn fn, void* arg);
+  /* number of closures this thread ran as a combiner */
+  size_t sstm_fc_combined();
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_FC_H_ */
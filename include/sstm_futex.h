@@ -0,0 +1,17 @@
+#ifndef _SSTM_FUTEX_H_
+#define	_SSTM_FUTEX_H_
+
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* internal to the runtime: the futex of the modules that park threads
+   (sstm_retry.c, sstm_resize.c, sstm_durable.c), not for applications */
+
+static inline long futex(volatile uint32_t* word, int op, uint32_t val, const struct timespec* timeout) {
+  return syscall(SYS_futex, word, op, val, timeout, NULL, 0);
+}
+
+#endif	/* _SSTM_FUTEX_H_ */
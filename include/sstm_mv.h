@@ -0,0 +1,86 @@
+#ifndef _SSTM_MV_H_
+#define	_SSTM_MV_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "sstm_numa.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_MV_PENDING 1	/* commit_ts of a writer about to take its timestamp */
+#define SSTM_MV_GC_PERIOD 64	/* commits between two garbage collections */
+#define SSTM_MV_MAX_VERSIONS 16	/* entries of a stripe chain, trimmed to half beyond */
+#define SSTM_MV_TOO_OLD_REASON 14 /* abort of a snapshot that needs a trimmed version */
+
+  /* a value overwritten by a commit: addr held value until the commit
+     with version superseded. Chained per stripe, newest first. */
+  typedef struct sstm_mv_entry
+  {
+    volatile uintptr_t* address;
+    uintptr_t value;
+    size_t superseded;
+    struct sstm_mv_entry* volatile next;
+  } sstm_mv_entry_t;
+
+  /* the versions of a stripe; written by committers holding its lock */
+  typedef struct sstm_mv_chain
+  {
+    sstm_mv_entry_t* volatile head; /* newest first */
+    size_t length;
+    volatile size_t horizon;	/* superseded version of the newest trimmed entry */
+  } sstm_mv_chain_t;
+
+  /* chains cut by the garbage collector, freed once every reader that
+     could be walking them has finished */
+  typedef struct sstm_mv_batch
+  {
+    sstm_mv_entry_t* chains;	/* cut chains, linked through their last entry */
+    size_t* seqs;		/* reader sequence numbers when the batch was sealed */
+    struct sstm_mv_batch* next;
+  } sstm_mv_batch_t;
+
+  /* per-thread multi-version state */
+  typedef struct sstm_mv_thread
+  {
+    volatile size_t active;	/* 0 idle, 1 taking a snapshot, 2 snapshot published */
+    volatile size_t seq;	/* odd while running a snapshot transaction */
+    volatile size_t snapshot[SSTM_MAX_NODES]; /* per-node clock values of the snapshot */
+    size_t lowwater[SSTM_MAX_NODES]; /* versions all present and future snapshots see */
+    size_t n_commits;		/* commits since the last garbage collection */
+    int fallback;		/* the snapshot was too old: restart without one */
+    sstm_mv_batch_t* open;	/* batch being filled */
+    sstm_mv_batch_t* retired;	/* sealed batches */
+  } sstm_mv_thread_t;
+
+  struct sstm_metadata;
+
+  /* keep the versions needed by snapshot transactions. Call after
+     sstm_start() and before the worker threads start. */
+  void sstm_mv_enable();
+  void sstm_mv_stop();
+  void sstm_mv_thread_stop(struct sstm_metadata* tx);
+  /* starts and ends a transaction that reads the current snapshot, in
+     mode SSTM_MODE_SNAPSHOT (read-only) or SSTM_MODE_SI. The restart of
+     a transaction whose snapshot was too old runs in
+     SSTM_MODE_OPTIMISTIC instead */
+  void sstm_mv_begin(struct sstm_metadata* tx, size_t mode);
+  void sstm_mv_end(struct sstm_metadata* tx);
+  /* reads addr as of the snapshot of tx; aborts only if the version was
+     trimmed from its chain */
+  uintptr_t sstm_mv_load(struct sstm_metadata* tx, volatile uintptr_t* addr);
+  /* snapshot isolation: no stripe we locked changed since the snapshot */
+  size_t sstm_mv_validate_writes(struct sstm_metadata* tx);
+  /* called by a committer holding the stripe lock, before overwriting
+     addr with the commit of version superseded */
+  void sstm_mv_push(struct sstm_metadata* tx, size_t stripe, volatile uintptr_t* addr, size_t superseded);
+  /* called after every update commit: periodic garbage collection */
+  void sstm_mv_on_commit(struct sstm_metadata* tx);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_MV_H_ */
@@ -0,0 +1,42 @@
+#ifndef _SSTM_NUMA_H_
+#define	_SSTM_NUMA_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_MAX_NODES 8	   /* must be a power of two */
+#define SSTM_NODE_BITS 3	   /* log2(SSTM_MAX_NODES) */
+#define SSTM_NUMA_MAX_REGIONS 16
+#define SSTM_NUMA_PAGE_SHIFT 12	   /* granularity of the interleaved mapping */
+
+  /* a memory region whose home node was declared by the application */
+  typedef struct sstm_numa_region
+  {
+    uintptr_t start;
+    uintptr_t end;
+    size_t node;
+  } sstm_numa_region_t;
+
+  /* number of memory nodes of the machine (1 on non-NUMA machines) */
+  size_t sstm_numa_nodes();
+  /* node of the cpu the calling thread currently runs on */
+  size_t sstm_numa_current_node();
+  /* allocates size bytes of memory homed on the given node */
+  void* sstm_numa_alloc_on_node(size_t size, size_t node);
+  /* moves the pages of [mem, mem + size) to node (page aligned) */
+  void sstm_numa_bind(void* mem, size_t size, size_t node);
+  void sstm_numa_free(void* mem, size_t size);
+  /* declares that [base, base + len) is homed on node, so that its stripes
+     are protected by the lock-table slice of that node.
+     Must be called before the worker threads start. */
+  void sstm_numa_region(void* base, size_t len, size_t node);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_NUMA_H_ */
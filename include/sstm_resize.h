@@ -0,0 +1,74 @@
+#ifndef _SSTM_RESIZE_H_
+#define	_SSTM_RESIZE_H_
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* needs sstm_window_t and sstm_lock_table_t: included by sstm.h */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_RESIZE_FLUSH 256	/* commits between two flushes of the thread counters */
+#define SSTM_RESIZE_WINDOW 16384 /* commits between two decisions */
+#define SSTM_RESIZE_MIN 512	/* locks per node: a page */
+#define SSTM_RESIZE_MAX (1 << 20) /* locks per node: 8MB */
+#define SSTM_RESIZE_GROW 4	/* factor a table grows by; it shrinks by 2 */
+#define SSTM_RESIZE_MIN_SHIFT 3	/* one lock per word */
+#define SSTM_RESIZE_MAX_SHIFT 6	/* one lock per cache line */
+#define SSTM_RESIZE_HIGH 1	/* false conflicts per 100 commits: more locks, or finer stripes */
+#define SSTM_RESIZE_CALM 4	/* windows under HIGH/8 before fewer locks, or coarser stripes */
+#define SSTM_RESIZE_YIELD 1024	/* pauses before the resizer yields the cpu */
+#define SSTM_RESIZE_IDLE_MS 100	/* the resizer frees replaced tables at least this often */
+
+  typedef struct sstm_resize_thread
+  {
+    size_t conflicts;		/* stripes found locked by another thread */
+    size_t false_table;		/* ... last locked for an address of another granule */
+    size_t false_shift;		/* ... last locked for another word of the same granule */
+    size_t flushed_commits;	/* n_commits at the last flush */
+    int blocked;		/* aborted by a closed table: waits for the next one */
+  } sstm_resize_thread_t;
+
+  typedef struct sstm_resize_global
+  {
+    int enabled;
+    sstm_window_t window;	/* commits, conflicts, false_table, false_shift */
+    size_t calm;		/* consecutive windows with few collisions */
+    size_t too_small;		/* largest size that had too many */
+    size_t calm_shift;		/* ... with few collisions within granules */
+    size_t too_coarse;		/* smallest shift that had too many, 0 if none */
+    volatile uint32_t pending;	/* futex word: next_size and next_shift wait for the resizer */
+    size_t next_size, next_shift;
+    volatile int stop;
+    pthread_t resizer;
+    size_t n_resizes;
+    size_t total_conflicts, total_false_table, total_false_shift;
+    sstm_lock_table_t* retired;	/* replaced tables, newest first */
+  } sstm_resize_global_t;
+
+  struct sstm_metadata;
+
+  /* lets the runtime resize the lock table and change the bytes covered
+     by a lock, from the rate of conflicts on a stripe last locked for
+     another address; a resizer thread replaces the table. Call after
+     sstm_start(), before the threads start; not with sstm_mv_enable() */
+  void sstm_resize_enable();
+  /* stops the resizer thread; by sstm_stop() */
+  void sstm_resize_stop();
+  void sstm_resize_print_stats();
+
+  /* the stripe of addr was found locked by another thread */
+  void sstm_resize_conflict(struct sstm_metadata* tx, size_t stripe, volatile uintptr_t* addr);
+  /* at the end of every transaction: flushes the counters when due and
+     moves the thread to the current table, once published if a closed
+     one turned the transaction away */
+  void sstm_resize_end(struct sstm_metadata* tx);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_RESIZE_H_ */
@@ -0,0 +1,50 @@
+#ifndef _SSTM_RETRY_H_
+#define	_SSTM_RETRY_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* needs sstm_lock_table_t: included by sstm.h */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_RETRY_REASON 40	/* abort reason of TX_RETRY */
+
+  typedef struct sstm_retry_thread
+  {
+    volatile uint32_t wake;	/* futex word, set by the writer that wakes us */
+    volatile size_t parked;	/* marks and table are published */
+    sstm_lock_table_t* table;	/* the table the marks index */
+    uint64_t* marks;		/* one bit per stripe of the read set we wait on */
+    size_t n_marked;		/* entries of the read set marked */
+    int any;			/* waits for any commit instead, on retry_seq */
+    uint32_t seq;		/* ... seen before checking that none happened */
+    int pending;		/* the abort being cleaned up is a retry */
+    size_t n_retries;
+  } sstm_retry_thread_t;
+
+  struct sstm_metadata;
+
+  /* see TX_RETRY: publishes what tx waits for and aborts it */
+  void sstm_tx_retry(struct sstm_metadata* tx);
+  /* at the end of the abort of a retry: sleeps until woken */
+  void sstm_retry_park(struct sstm_metadata* tx);
+  /* a writer that saw parked threads when it committed wakes those
+     waiting on a stripe it wrote; after its locks are released */
+  void sstm_retry_wake(struct sstm_metadata* tx);
+  /* the same for a writer of the global-lock and NOrec backends, which
+     only wakes the threads waiting for any commit */
+  void sstm_retry_wake_any();
+  /* wakes every parked thread, e.g. when their stripes move to a new table */
+  void sstm_retry_wake_all();
+  void sstm_retry_thread_stop(struct sstm_metadata* tx);
+  /* prints the retries of the stopped threads, if any */
+  void sstm_retry_print_stats();
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_RETRY_H_ */
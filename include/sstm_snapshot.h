@@ -0,0 +1,69 @@
+#ifndef _SSTM_SNAPSHOT_H_
+#define	_SSTM_SNAPSHOT_H_
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_SNAPSHOT_MAX_REGIONS 16
+#define SSTM_SNAPSHOT_BLOCK_SHIFT 12 /* a block of stripes is copied at once: a page */
+#define SSTM_SNAPSHOT_YIELD 1024 /* pauses before a writer waiting for the snapshot yields the cpu */
+
+  /* a memory region that snapshots copy */
+  typedef struct sstm_snapshot_region
+  {
+    uintptr_t start;
+    size_t len;
+    size_t block;		/* index of its first block */
+    size_t offset;		/* of its copy in a snapshot */
+  } sstm_snapshot_region_t;
+
+  typedef struct sstm_snapshot_thread
+  {
+    volatile size_t epoch;	/* of the write-back in progress, 0 if none */
+  } sstm_snapshot_thread_t;
+
+  typedef struct sstm_snapshot_global
+  {
+    sstm_snapshot_region_t regions[SSTM_SNAPSHOT_MAX_REGIONS];
+    size_t n_regions;
+    size_t size;		/* bytes of a snapshot */
+    size_t n_blocks;
+    volatile uint8_t* blocks;	/* per block: not copied, being copied, copied */
+    uint8_t* copy;		/* the snapshot being taken */
+    volatile size_t epoch;	/* commits of an older epoch precede the snapshot */
+    volatile size_t copying;	/* epoch of the snapshot being taken, 0 if none */
+    volatile int drained;	/* ... and its older commits are written back */
+    pthread_mutex_t lock;	/* one snapshot at a time */
+    size_t n_snapshots, n_cow;
+  } sstm_snapshot_global_t;
+
+  struct sstm_metadata;
+
+  /* declares that snapshots copy [base, base + len), after the regions
+     declared before. Call before the threads start */
+  void sstm_snapshot_region(void* base, size_t len);
+  /* bytes of a snapshot: the regions, one after the other */
+  size_t sstm_snapshot_size();
+  /* copies a consistent state of the regions to buf while transactions
+     keep running: every commit is either entirely in it or not at all */
+  void sstm_snapshot_take(void* buf);
+  /* the same, to the file at path */
+  void sstm_snapshot_write(const char* path);
+  void sstm_snapshot_print_stats();
+
+  /* a writer with all its stripes locked, before it validates: copies
+     the blocks it writes first if a snapshot is being taken */
+  void sstm_snapshot_commit(struct sstm_metadata* tx);
+  /* after its write-back, or a failed validation */
+  void sstm_snapshot_commit_end(struct sstm_metadata* tx);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_SNAPSHOT_H_ */
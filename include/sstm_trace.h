@@ -0,0 +1,80 @@
+#ifndef _SSTM_TRACE_H_
+#define	_SSTM_TRACE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_TRACE_EVENTS (1 << 16) /* per thread, the last ones are kept: 1MB */
+#define SSTM_TRACE_THREADS 256	/* slots of a trace file: SSTM_MAX_THREADS */
+#define SSTM_TRACE_MAGIC 0x5353544d54524345ULL
+
+  enum
+  {
+    SSTM_TRACE_BEGIN = 1,	/* a transaction (re)starts */
+    SSTM_TRACE_LOAD_CONFLICT,	/* a load found the stripe locked (aux: owner, 0 if it changed) */
+    SSTM_TRACE_STORE_LOCK,	/* a store locked the stripe */
+    SSTM_TRACE_STORE_CONFLICT,	/* a store found the stripe locked (aux: owner) */
+    SSTM_TRACE_VALIDATE,	/* arg: 1 if valid; stripe: entries of the read set */
+    SSTM_TRACE_COMMIT,
+    SSTM_TRACE_ABORT,		/* arg: reason */
+    SSTM_TRACE_TYPES
+  };
+
+  /* an event, timestamped with getticks() */
+  typedef struct sstm_trace_event
+  {
+    uint64_t ticks;
+    uint32_t stripe;
+    uint16_t aux;
+    uint8_t type;
+    uint8_t arg;
+  } sstm_trace_event_t;
+
+  /* the start of a trace file, followed by the event rings of the slots */
+  typedef struct sstm_trace_header
+  {
+    uint64_t magic;
+    uint64_t ticks_per_us;
+    uint64_t n_events;		/* per slot */
+    uint64_t n_slots;
+    struct
+    {
+      volatile uint64_t head;	/* events written by the thread of this id */
+      uint64_t padding[7];
+    } slots[SSTM_TRACE_THREADS];
+  } sstm_trace_header_t;
+
+  typedef struct sstm_trace_thread
+  {
+    sstm_trace_event_t* events;	/* our ring in the file, NULL if not tracing */
+    volatile uint64_t* head;
+    uint64_t n;
+  } sstm_trace_thread_t;
+
+  struct sstm_metadata;
+
+  /* records the events of every thread started afterwards in the file at
+     path (sstm_start() calls it if SSTM_TRACE is set). Read the file with
+     trace_report */
+  void sstm_trace_enable(const char* path);
+  void sstm_trace_stop();
+  void sstm_trace_thread_start(struct sstm_metadata* tx);
+  void sstm_trace_thread_stop(struct sstm_metadata* tx);
+  void sstm_trace_record(struct sstm_metadata* tx, int type, int arg, int aux, size_t stripe);
+
+  /* the check is inlined: nothing else is done when not tracing */
+#define SSTM_TRACE(tx, type, arg, aux, stripe)				\
+  if ((tx)->trace.events != NULL)					\
+    {									\
+      sstm_trace_record(tx, type, arg, aux, stripe);			\
+    }
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_TRACE_H_ */
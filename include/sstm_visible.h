@@ -0,0 +1,41 @@
+#ifndef _SSTM_VISIBLE_H_
+#define	_SSTM_VISIBLE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* needs sstm_lock_table_t: included by sstm.h */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_VISIBLE_DEFER 256	/* pauses a writer waits for the readers of a stripe before aborting */
+#define SSTM_VISIBLE_YIELD 1024	/* pauses before a reader waiting for a writer yields the cpu */
+
+  typedef struct sstm_visible_thread
+  {
+    uint64_t* marks;		/* one bit per stripe we are a reader of */
+    size_t n_marks;		/* stripes the marks cover */
+  } sstm_visible_thread_t;
+
+  struct sstm_metadata;
+
+  /* makes the running transaction a visible reader (see TX_START_VISIBLE) */
+  void sstm_visible_begin(struct sstm_metadata* tx);
+  /* counts tx as a reader of the stripe of addr and waits for a writer
+     that holds it to finish; 0 if tx aborted */
+  size_t sstm_visible_register(struct sstm_metadata* tx, volatile uintptr_t* addr);
+  uintptr_t sstm_visible_load(struct sstm_metadata* tx, volatile uintptr_t* addr);
+  /* drops the reader counts of tx, at commit or abort */
+  void sstm_visible_end(struct sstm_metadata* tx);
+  void sstm_visible_thread_stop(struct sstm_metadata* tx);
+  /* a writer about to lock stripe, or that has just locked it, waits for
+     its readers to leave; 0 if some are still there, and it must abort */
+  size_t sstm_visible_defer(sstm_lock_table_t* table, size_t stripe);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_VISIBLE_H_ */
@@ -0,0 +1,61 @@
+#ifndef _SSTM_WINDOW_H_
+#define	_SSTM_WINDOW_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* needs ptlock_t: included by sstm.h after lock_if.h */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define SSTM_WINDOW_COUNTS 4	/* counters of a window, the first one its commits */
+
+  /* windowed statistics, for the runtime modules that adapt to them
+     (sstm_adapt.c, sstm_resize.c): threads flush their counters into the
+     current window every few commits, and the thread that completes it
+     takes the counts out and decides on them, alone */
+  typedef struct sstm_window
+  {
+    ptlock_t decide_lock;	/* one thread decides at a time */
+    volatile size_t counts[SSTM_WINDOW_COUNTS]; /* current window */
+  } sstm_window_t;
+
+  typedef void (*sstm_window_fn)(const size_t* counts);
+
+  /* adds the n counts of a thread to the window. If it now holds length
+     commits, one thread moves them out and calls decide on them */
+  static inline void
+  sstm_window_flush(sstm_window_t* w, const size_t* counts, size_t n, size_t length, sstm_window_fn decide)
+  {
+    size_t window[SSTM_WINDOW_COUNTS];
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+      __sync_fetch_and_add(&w->counts[i], counts[i]);
+    }
+    if (w->counts[0] >= length && TRYLOCK(&w->decide_lock)) {
+      if (w->counts[0] >= length) {
+        for (i = 0; i < n; i++) {
+          window[i] = w->counts[i];
+          __sync_fetch_and_sub(&w->counts[i], window[i]);
+        }
+        decide(window);
+      }
+      UNLOCK(&w->decide_lock);
+    }
+  }
+
+  /* events reach pct per 100 of total */
+  static inline int
+  sstm_window_above(size_t events, size_t total, size_t pct)
+  {
+    return 100 * events >= pct * total;
+  }
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SSTM_WINDOW_H_ */
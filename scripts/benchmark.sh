@@ -19,8 +19,7 @@ nc=$(nproc);
 b0="bank_glstm"
 b1="bank"
 
-l0="ll_glstm"
-l1="ll"
+sets="ll sl ht rbt";
 
 
 workloads="-r100 -r20 -r0";
@@ -49,22 +48,26 @@ done;
 
 workloads="-u0 -u20 -u100";
 
-echo "## LL ####################################";
-for w in $workloads;
+for l1 in $sets;
 do
-    echo "# workload: $w";
-    echo "#Thrd Throughput-gl Throughput-yours Ratio"
-    for ((i = 1; i <= $nc; i++))
+    l0="${l1}_glstm";
+    echo "## $l1 ####################################";
+    for w in $workloads;
     do
-	ri=$(($ri+1));
-	printf "%-5d " $i;
-	thr0=$(./$l0 $w -n$i -d$duration | awk '/# Commits/ { print $5 }');
-	printf "%-13d " $thr0;
-	thr1=$(./$l1 $w -n$i -d$duration | awk '/# Commits/ { print $5 }');
-	printf "%-16d " $thr1;
-	ratio=$(echo $thr1/$thr0 | bc -l);
-	printf "%-7.2f\n" $ratio;
-	rt=$(echo "$rt+$ratio" | bc -l);
+	echo "# workload: $w";
+	echo "#Thrd Throughput-gl Throughput-yours Ratio"
+	for ((i = 1; i <= $nc; i++))
+	do
+	    ri=$(($ri+1));
+	    printf "%-5d " $i;
+	    thr0=$(./$l0 $w -n$i -d$duration | awk '/# Commits/ { print $5 }');
+	    printf "%-13d " $thr0;
+	    thr1=$(./$l1 $w -n$i -d$duration | awk '/# Commits/ { print $5 }');
+	    printf "%-16d " $thr1;
+	    ratio=$(echo $thr1/$thr0 | bc -l);
+	    printf "%-7.2f\n" $ratio;
+	    rt=$(echo "$rt+$ratio" | bc -l);
+	done;
     done;
 done;
 
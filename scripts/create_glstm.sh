@@ -9,19 +9,31 @@ make &> /dev/null;
 mv bank bank_glstm &> /dev/null;
 mv ll ll_glstm &> /dev/null;
 
+# the other sets only use the base interface: build them against glstm,
+# with the harness they share
+mkdir -p set_bench_glstm;
+git show master:include/set_bench.h > set_bench_glstm/set_bench.h 2> /dev/null;
+for b in sl ht rbt;
+do
+    git show master:src/$b.c > ${b}_glstm.c 2> /dev/null &&
+	cc -O2 -I./include -I./set_bench_glstm ${b}_glstm.c -o ${b}_glstm -lpthread -L. -lsstm &> /dev/null;
+    rm -f ${b}_glstm.c;
+done;
+rm -rf set_bench_glstm;
+
 git co master &> /dev/null;
 git stash pop &> /dev/null;
 
-echo "!! created bank_glstm and ll_glstm executables."
+echo "!! created bank_glstm, ll_glstm, sl_glstm, ht_glstm and rbt_glstm executables."
 
 make clean &> /dev/null;
 make > /dev/null;
 
 if [ $? -eq 0 ];
 then
-    echo "!! created bank and ll executables -- your algorithm"
+    echo "!! created bank, ll, sl, ht and rbt executables -- your algorithm"
     exit 0;
 else
-    echo "!! ERROR creating bank and ll executables -- your algorithm"
+    echo "!! ERROR creating bank, ll, sl, ht and rbt executables -- your algorithm"
     exit 1;
 fi
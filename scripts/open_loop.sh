@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# throughput vs. latency of bank in open loop, up to saturation:
+#   ./scripts/open_loop.sh [threads] [bank options...]
+
+duration=2;
+threads=${1:-$(nproc)};
+shift;
+
+rates="1000 2000 5000 10000 20000 50000 100000 200000 500000 1000000 2000000";
+
+echo "#Offered  Done       Late       p50(us)    p99(us)    p99.9(us)";
+for r in $rates;
+do
+    out=$(./bank -n$threads -d$duration -O$r "$@");
+    echo "$out" | awk -v r=$r '
+/# Open loop/ { done = $7; late = $10 }
+/# Latency/ { for (i = 4; i < NF; i += 2) lat[$i] = $(i + 1) }
+END { sub("us", "", lat["p50"]); sub("us", "", lat["p99"]); sub("us", "", lat["p99.9"]);
+      printf("%-9d %-10d %-10d %-10s %-10s %-10s\n", r, done, late, lat["p50"], lat["p99"], lat["p99.9"]) }';
+    # past saturation: a quarter of the offered load is left undone
+    late=$(echo "$out" | awk '/# Open loop/ { print $10 }');
+    if [ $(($late * 4)) -gt $(($r * $duration)) ];
+    then
+	break;
+    fi;
+done;
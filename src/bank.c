@@ -1,12 +1,19 @@
 #include <assert.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <signal.h>
 #include <malloc.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "sstm.h"
 #include "random.h"
+#include "phases.h"
 __thread unsigned long* seeds; 
 
 /*
@@ -26,9 +33,48 @@ __thread unsigned long* seeds;
 #define DEFAULT_WRITE_THREADS           0
 #define DEFAULT_DISJOINT                0
 #define DEFAULT_VERBOSE                 0
+#define DEFAULT_MVCC                    0
+#define DEFAULT_SI                      0
+#define DEFAULT_WRITE_THROUGH           0
+#define DEFAULT_SPIN                    0
+#define DEFAULT_COMMUTATIVE             0
+#define DEFAULT_COMBINING               0
+#define DEFAULT_ADAPTIVE                0
+#define DEFAULT_RESIZE                  0
+#define DEFAULT_VISIBLE                 0
+#define DEFAULT_GROUP_WINDOW            SSTM_DURABLE_WINDOW_US
+#define DEFAULT_ZIPF                    0
+#define DEFAULT_RATE                    0
+#define DEFAULT_CONSUMERS               0
+#define LATENCY_BUCKETS                 976 /* 16 per power of 2 of ns, up to 2^64 */
+#define MAX_SLEEP_NS                    10000000
+#define COMBINING_WINDOW                1024
+#define COMBINING_STAY                  8
+#define COMBINING_MIN_BATCH             2 /* closures per combining transaction worth delegating */
+#define PRODUCE_EVERY                   16 /* transfers of a producer, one of which feeds the inbox */
+#define CONSUME_MIN                     8 /* balance of the inbox a consumer waits for */
 
 int delay = DEFAULT_DELAY;
 int test_verbose = DEFAULT_VERBOSE;
+int mvcc = DEFAULT_MVCC;
+int si = DEFAULT_SI;
+int write_through = DEFAULT_WRITE_THROUGH;
+int spin = DEFAULT_SPIN;
+int commutative = DEFAULT_COMMUTATIVE;
+int combining = DEFAULT_COMBINING;
+size_t combining_groups = 1;
+int adaptive = DEFAULT_ADAPTIVE;
+int resize = DEFAULT_RESIZE;
+int visible = DEFAULT_VISIBLE;
+char* durable = NULL;
+char* backup = NULL;
+int group_window = DEFAULT_GROUP_WINDOW;
+double zipf_theta = DEFAULT_ZIPF;
+zipf_t zipf;
+uint64_t rate = DEFAULT_RATE;
+int consumers = DEFAULT_CONSUMERS;
+char* phases_path = NULL;
+char* timeline = "timeline.csv";
 int argc;
 char **argv;
 
@@ -53,6 +99,9 @@ typedef struct bank
 {
   account_t* accounts;
   size_t size;
+  int64_t last_total;		/* published by snapshot-isolation read-alls */
+  account_t inbox;		/* fed by the producers, emptied by the consumers (-Q) */
+  uintptr_t closed;		/* the producers are done: consumers take what is left */
 } bank_t;
 
 static bank_t* bank;
@@ -61,6 +110,16 @@ int
 transfer(account_t* src, account_t* dst, int amount) 
 {
   /* Allow overdrafts */
+  if (commutative)
+    {
+      /* the balances are not read: transfers on the same accounts commute */
+      TX_START();
+      TX_ADD(&src->balance, -amount);
+      TX_ADD(&dst->balance, amount);
+      TX_COMMIT();
+      return amount;
+    }
+
   TX_START();
   int64_t i, j;
   i = TX_LOAD(&src->balance);
@@ -74,6 +133,26 @@ transfer(account_t* src, account_t* dst, int amount)
   return amount;
 }
 
+typedef struct transfer_args
+{
+  account_t* src;
+  account_t* dst;
+  int amount;
+} transfer_args_t;
+
+/* the body of transfer(), run by a combiner */
+static uintptr_t
+transfer_delegated(void* arg)
+{
+  transfer_args_t* t = (transfer_args_t*) arg;
+  int64_t i, j;
+  i = TX_LOAD(&t->src->balance);
+  j = TX_LOAD(&t->dst->balance);
+  TX_STORE(&t->src->balance, i - t->amount);
+  TX_STORE(&t->dst->balance, j + t->amount);
+  return t->amount;
+}
+
 void
 check_accs(account_t* acc1, account_t* acc2) 
 {
@@ -92,14 +171,16 @@ check_accs(account_t* acc1, account_t* acc2)
     }
 }
 
+#define TOTAL_CHUNK                     64
+
 int
 total(bank_t* bank, int transactional) 
 {
-  int i, total;
+  int i, j, total;
 
   if (!transactional)
     {
-      total = 0;
+      total = bank->inbox.balance;
       for (i = 0; i < bank->size; i++)
 	{
 	  total += bank->accounts[i].balance;
@@ -107,11 +188,38 @@ total(bank_t* bank, int transactional)
     }
   else
     {
-      TX_START();
-      total = 0;
-      for (i = 0; i < bank->size; i++)
+      /* copy the accounts chunk by chunk: one read-set entry per stripe */
+      account_t chunk[TOTAL_CHUNK];
+      if (si)
+	{
+	  TX_START_SI();
+	}
+      else if (mvcc)
+	{
+	  TX_START_RO();
+	}
+      else if (visible)
+	{
+	  TX_START_VISIBLE();
+	}
+      else
+	{
+	  TX_START();
+	}
+      total = consumers > 0 ? TX_LOAD(&bank->inbox.balance) : 0;
+      for (i = 0; i < bank->size; i += TOTAL_CHUNK)
 	{
-	  total += TX_LOAD(&bank->accounts[i].balance);
+	  int n = bank->size - i < TOTAL_CHUNK ? bank->size - i : TOTAL_CHUNK;
+	  TX_LOAD_RANGE(chunk, &bank->accounts[i], n * sizeof(account_t));
+	  for (j = 0; j < n; j++)
+	    {
+	      total += chunk[j].balance;
+	    }
+	}
+      if (si)
+	{
+	  /* the dashboard update: only conflicts with other read-alls */
+	  TX_STORE(&bank->last_total, total);
 	}
       TX_COMMIT();
     }
@@ -124,6 +232,38 @@ total(bank_t* bank, int transactional)
   return total;
 }
 
+/* moves the inbox to dst once it holds CONSUME_MIN, or anything left
+   once it is closed; blocks in TX_RETRY until then. Returns the amount
+   moved, 0 once closed and empty */
+int64_t
+consume(bank_t* bank, account_t* dst)
+{
+  TX_START();
+  int64_t n = TX_LOAD(&bank->inbox.balance);
+  if (n < CONSUME_MIN && !TX_LOAD(&bank->closed))
+    {
+      TX_RETRY();
+    }
+  if (n > 0)
+    {
+      TX_STORE(&bank->inbox.balance, 0);
+      TX_STORE(&dst->balance, TX_LOAD(&dst->balance) + n);
+    }
+  TX_COMMIT();
+
+  return n;
+}
+
+/* a committed write to a word the parked consumers read: wakes them all
+   to empty the inbox. Not in main, whose locals a restart would clobber */
+void
+close_inbox(bank_t* bank)
+{
+  TX_START();
+  TX_STORE(&bank->closed, 1);
+  TX_COMMIT();
+}
+
 void
 reset(bank_t *bank) 
 {
@@ -148,6 +288,9 @@ typedef struct thread_data
   uint64_t nb_checks;
   uint64_t nb_read_all;
   uint64_t nb_write_all;
+  uint64_t nb_delegated;
+  uint64_t nb_produced;		/* units put in the inbox */
+  uint64_t nb_consumed;		/* units taken from it */
   int32_t id;
   int32_t read_cores;
   int32_t write_cores;
@@ -156,11 +299,69 @@ typedef struct thread_data
   int32_t check;
   size_t duration;
   uint32_t nb_accounts;
+  double gap_ns;		/* mean time between two transactions, open loop */
+  uint64_t* latencies;		/* histogram, open loop */
+  uint64_t nb_late;		/* were due when the run ended */
 } thread_data_t;
 
 
 volatile int work = 1;
 
+static inline uint64_t
+now_ns()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* log-linear, 16 buckets per power of 2: values are within 6% */
+static inline size_t
+latency_bucket(uint64_t ns)
+{
+  int k;
+  if (ns < 16)
+    {
+      return ns;
+    }
+  k = 63 - __builtin_clzll(ns);
+  return (k - 3) * 16 + ((ns >> (k - 4)) & 15);
+}
+
+/* the smallest value of bucket b */
+static inline uint64_t
+latency_value(size_t b)
+{
+  if (b < 16)
+    {
+      return b;
+    }
+  return (uint64_t) (16 + b % 16) << (b / 16 - 1);
+}
+
+/* sleeps until due, or until the run ends */
+static void
+wait_until(uint64_t due)
+{
+  uint64_t now;
+  while (work && (now = now_ns()) < due)
+    {
+      struct timespec ts = { 0, due - now < MAX_SLEEP_NS ? due - now : MAX_SLEEP_NS };
+      nanosleep(&ts, NULL);
+    }
+}
+
+/* busy: think time that keeps the core, as work between transactions */
+static void
+think(uint64_t ns)
+{
+  uint64_t end = now_ns() + ns;
+  while (now_ns() < end)
+    {
+      PAUSE_IN();
+    }
+}
+
 void*
 test(void *data) 
 {
@@ -181,10 +382,51 @@ test(void *data)
 
   TM_THREAD_START();
 
+  /* adaptive combining: a window of transfers with too many aborts sends
+     the next COMBINING_STAY windows to the combiner, then we try again.
+     We stop early if the combining transactions we run batch too few
+     closures: the other threads no longer delegate */
+  size_t ops = 0, delegate = 0;
+  size_t last_commits = 0, last_aborts = 0, last_combined = 0;
+  size_t produce = 0;
+
+  /* open loop: the transactions are due on a Poisson schedule whether the
+     previous ones are done or not, and their latency counts from when
+     they were due, so that a stall is charged to all the transactions it
+     delays (no coordinated omission) */
+  uint64_t due = now_ns();
+  if (rate > 0)
+    {
+      prctl(PR_SET_TIMERSLACK, 1);
+    }
+
   while(work)
     {
+      if (rate > 0)
+	{
+	  due += -log(1 - (fast_rand() >> 11) * (1.0 / (1ULL << 53))) * d->gap_ns;
+	  wait_until(due);
+	  if (!work)
+	    {
+	      break;
+	    }
+	}
+
+      /* a phase script changes the mix and the threads as it goes */
+      phase_t* phase = phase_current();
+      int read_all_lim = d->read_all, check_lim = d->check;
+      if (phase != NULL)
+	{
+	  if (!phase_wait(d->id))
+	    {
+	      break;
+	    }
+	  read_all_lim = phase->read_all * 128 / 100;
+	  check_lim = read_all_lim + d->check - d->read_all;
+	}
+
       uint8_t nb = fast_rand() & 127;
-      if (is_read_core || nb < d->read_all)
+      if (is_read_core || nb < read_all_lim)
 	{
 	  /* Read all */
 	  total(bank_local, 1);
@@ -194,23 +436,112 @@ test(void *data)
 	{
 	  /* Choose fast_random accounts */
 
-	  uint32_t src = fast_rand() % rand_max;
-	  uint32_t dst = fast_rand() % rand_max;
+	  uint32_t src, dst;
+	  if (phase != NULL)
+	    {
+	      src = phase_key(phase, rand_max);
+	      dst = phase_key(phase, rand_max);
+	    }
+	  else if (zipf_theta > 0)
+	    {
+	      src = zipf_key(&zipf);
+	      dst = zipf_key(&zipf);
+	    }
+	  else
+	    {
+	      src = fast_rand() % rand_max;
+	      dst = fast_rand() % rand_max;
+	    }
 	  if (dst == src)
 	    {
 	      dst = ((src + 1) % rand_max);
 	    }
-	  if (nb < d->check)
+	  if (nb < check_lim)
 	    {
 	      check_accs(bank_local->accounts + src, bank_local->accounts + dst);
 	      d->nb_checks++;
 	    }
+	  else if (consumers > 0 && ++produce % PRODUCE_EVERY == 0)
+	    {
+	      transfer(bank_local->accounts + src, &bank_local->inbox, 1);
+	      d->nb_transfer++;
+	      d->nb_produced++;
+	    }
+	  else if (delegate > 0)
+	    {
+	      /* by source account: the transfers out of an account are
+		 serialized by one combiner, the others run in parallel */
+	      transfer_args_t args = { bank_local->accounts + src, bank_local->accounts + dst, 1 };
+	      sstm_fc_execute(src % combining_groups, transfer_delegated, &args);
+	      d->nb_transfer++;
+	      d->nb_delegated++;
+	    }
 	  else
 	    {
 	      transfer(bank_local->accounts + src, bank_local->accounts + dst, 1);
 	      d->nb_transfer++;
 	    }
+
+	  if (combining > 0 && ++ops % COMBINING_WINDOW == 0)
+	    {
+	      size_t commits = sstm_meta.n_commits - last_commits;
+	      size_t aborts = sstm_meta.n_aborts - last_aborts;
+	      size_t combined = sstm_fc_combined() - last_combined;
+	      last_commits = sstm_meta.n_commits;
+	      last_aborts = sstm_meta.n_aborts;
+	      last_combined = sstm_fc_combined();
+	      if (delegate > 0)
+		{
+		  /* while delegating, our commits are mostly combining
+		     transactions */
+		  delegate = combined > 0 && combined < COMBINING_MIN_BATCH * commits ? 0 : delegate - 1;
+		}
+	      else if (100 * aborts > combining * (commits + aborts))
+		{
+		  delegate = COMBINING_STAY;
+		}
+	    }
 	}
+
+      if (rate > 0)
+	{
+	  d->latencies[latency_bucket(now_ns() - due)]++;
+	}
+      else if (delay > 0)
+	{
+	  think(delay);
+	}
+    }
+
+  /* the backlog: due before the end, never started */
+  if (rate > 0)
+    {
+      uint64_t end = now_ns();
+      while (due < end)
+	{
+	  d->nb_late++;
+	  due += -log(1 - (fast_rand() >> 11) * (1.0 / (1ULL << 53))) * d->gap_ns;
+	}
+    }
+
+  TM_THREAD_STOP();
+
+  return NULL;
+}
+
+/* empties the inbox into random accounts until it is closed and empty */
+void*
+consumer(void* data)
+{
+  thread_data_t* d = (thread_data_t*) data;
+  int64_t n;
+
+  seed_rand();
+  TM_THREAD_START();
+
+  while ((n = consume(bank, bank->accounts + fast_rand() % d->nb_accounts)) > 0)
+    {
+      d->nb_consumed += n;
     }
 
   TM_THREAD_STOP();
@@ -218,6 +549,97 @@ test(void *data)
   return NULL;
 }
 
+/* percentiles of the latencies of all threads, from when the
+   transactions were due */
+void
+print_latencies(thread_data_t* data, int num_threads, int duration)
+{
+  static const double percentiles[] = { 50, 90, 99, 99.9, 100 };
+  uint64_t hist[LATENCY_BUCKETS] = { 0 };
+  uint64_t n = 0, late = 0, seen = 0;
+  size_t t, b, p = 0;
+
+  for (t = 0; t < num_threads; t++)
+    {
+      for (b = 0; b < LATENCY_BUCKETS; b++)
+	{
+	  hist[b] += data[t].latencies[b];
+	  n += data[t].latencies[b];
+	}
+      late += data[t].nb_late;
+      free(data[t].latencies);
+    }
+  printf("# Open loop: %-10lu tx/s offered, %.0f tx/s done, %lu not started\n", (unsigned long) rate,
+	 (double) n / duration, (unsigned long) late);
+  printf("# Latency  :");
+  for (b = 0; b < LATENCY_BUCKETS && p < sizeof(percentiles) / sizeof(percentiles[0]); b++)
+    {
+      seen += hist[b];
+      while (p < sizeof(percentiles) / sizeof(percentiles[0]) && n > 0 && seen >= percentiles[p] / 100 * n)
+	{
+	  /* the upper bound of the bucket */
+	  if (percentiles[p] < 100)
+	    {
+	      printf(" p%g %.1fus", percentiles[p], latency_value(b + 1) / 1000.0);
+	    }
+	  else
+	    {
+	      printf(" max %.1fus", latency_value(b + 1) / 1000.0);
+	    }
+	  p++;
+	}
+    }
+  printf("\n");
+}
+
+/* sum of the balances in a backup file */
+int64_t
+backup_total(const char* path, size_t nb_accounts)
+{
+  int fd = open(path, O_RDONLY);
+  account_t* accounts = mmap(NULL, nb_accounts * sizeof (account_t), PROT_READ, MAP_SHARED, fd, 0);
+  int64_t total = 0;
+  size_t i;
+
+  assert(accounts != MAP_FAILED);
+  for (i = 0; i < nb_accounts; i++)
+    {
+      total += accounts[i].balance;
+    }
+  munmap(accounts, nb_accounts * sizeof (account_t));
+  close(fd);
+  return total;
+}
+
+/* backs the accounts and the inbox up while the transfers run: every
+   copy must sum to 0 */
+void
+backup_loop(int duration)
+{
+  struct timespec start, t0, t1;
+  size_t n = 0;
+  double copy_s = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do
+    {
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      sstm_snapshot_write(backup);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      copy_s += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+      n++;
+      int64_t tot = backup_total(backup, bank->size + 1); // and the inbox
+      if (tot != 0)
+	{
+	  printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\tBackup total must always be 0! (%ld)\n", (long) tot);
+	}
+      assert(tot == 0);
+    }
+  while (t1.tv_sec - start.tv_sec < duration);
+  printf("# Backups: %-10zu of %zu bytes, %.2f ms each (%.2f GB/s)\n", n, sstm_snapshot_size(),
+	 1e3 * copy_s / n, n * sstm_snapshot_size() / copy_s / 1e9);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -233,6 +655,23 @@ main(int argc, char **argv)
       {"check", required_argument, NULL, 'c'},
       {"read-threads", required_argument, NULL, 'R'},
       {"verbose", no_argument, NULL, 'v'},
+      {"mvcc", no_argument, NULL, 'm'},
+      {"snapshot-isolation", no_argument, NULL, 's'},
+      {"write-through", no_argument, NULL, 'w'},
+      {"spin", required_argument, NULL, 'S'},
+      {"commutative", no_argument, NULL, 'A'},
+      {"combining", required_argument, NULL, 'F'},
+      {"adaptive", no_argument, NULL, 'x'},
+      {"resize", no_argument, NULL, 'L'},
+      {"visible", no_argument, NULL, 'V'},
+      {"durable", required_argument, NULL, 'P'},
+      {"group-window", required_argument, NULL, 'G'},
+      {"backup", required_argument, NULL, 'B'},
+      {"zipf", required_argument, NULL, 'z'},
+      {"rate", required_argument, NULL, 'O'},
+      {"phases", required_argument, NULL, 'p'},
+      {"timeline", required_argument, NULL, 't'},
+      {"consumers", required_argument, NULL, 'Q'},
       {NULL, 0, NULL, 0}
     };
 
@@ -259,7 +698,7 @@ main(int argc, char **argv)
   while (1)
     {
       i = 0;
-      c = getopt_long(argc, argv, "hn:a:d:r:c:R:v", long_options, &i);
+      c = getopt_long(argc, argv, "hn:a:d:D:r:c:R:vmswS:AF:xLVP:G:B:z:O:p:t:Q:", long_options, &i);
 
       if (c == -1)
 	break;
@@ -285,14 +724,48 @@ main(int argc, char **argv)
 		 "        Number of accounts in the bank (default=" XSTR(DEFAULT_NB_ACCOUNTS) ")\n"
 		 "  -d, --duration <double>\n"
 		 "        Test duration in seconds (0=infinite, default=" XSTR(DEFAULT_DURATION) ")\n"
-		 "  -d, --delay <int>\n"
-		 "        Delay ns after succesfull request. Used to understress the system, default=" XSTR(DEFAULT_DELAY) ")\n"
+		 "  -D, --delay <int>\n"
+		 "        Busy ns after every transaction, to understress the system (default=" XSTR(DEFAULT_DELAY) ")\n"
+		 "  -O, --rate <int>\n"
+		 "        Open loop: transactions per second of all threads together, on a Poisson schedule; reports their latency (0=closed loop, default=" XSTR(DEFAULT_RATE) ")\n"
+		 "  -p, --phases <file>\n"
+		 "        Run the steps of a phase script instead of -d: lines of <seconds> <read-all %%> <update %%> <zipf theta> <threads>\n"
+		 "  -t, --timeline <file>\n"
+		 "        Commit and abort rates every " XSTR(PHASES_SAMPLE_MS) "ms of a phase script, as csv (default=timeline.csv)\n"
 		 "  -c, --check <int>\n"
 		 "        Percentage of check transactions transactions (default=" XSTR(DEFAULT_CHECK) ")\n"
+		 "  -Q, --consumers <int>\n"
+		 "        Threads that block in TX_RETRY until the inbox fed by one transfer in " XSTR(PRODUCE_EVERY) " holds " XSTR(CONSUME_MIN) ", then empty it (default=" XSTR(DEFAULT_CONSUMERS) ")\n"
 		 "  -r, --read-all-rate <int>\n"
 		 "        Percentage of read-all transactions (default=" XSTR(DEFAULT_READ_ALL) ")\n"
 		 "  -R, --read-threads <int>\n"
 		 "        Number of threads issuing only read-all transactions (default=" XSTR(DEFAULT_READ_THREADS) ")\n"
+		 "  -m, --mvcc\n"
+		 "        Read-all transactions read a multi-version snapshot without validation\n"
+		 "  -s, --snapshot-isolation\n"
+		 "        Read-all transactions run under snapshot isolation and publish the total\n"
+		 "  -w, --write-through\n"
+		 "        Stores write in place with an undo log instead of being buffered\n"
+		 "  -S, --spin <int>\n"
+		 "        Pauses to wait for a locked stripe before aborting (default=" XSTR(DEFAULT_SPIN) ")\n"
+		 "  -A, --commutative\n"
+		 "        Transfers add to the balances with TX_ADD instead of reading them\n"
+		 "  -F, --combining <int>\n"
+		 "        Delegate transfers to a combiner while the abort rate exceeds this percentage (0=never, default=" XSTR(DEFAULT_COMBINING) ")\n"
+		 "  -x, --adaptive\n"
+		 "        Switch between the optimistic, global-lock and NOrec backends at runtime\n"
+		 "  -L, --resize\n"
+		 "        Resize the lock table at runtime from the rate of false conflicts\n"
+		 "  -V, --visible\n"
+		 "        Read-all transactions are visible readers: writers defer to them\n"
+		 "  -P, --durable <file>\n"
+		 "        Log the balances to file and recover them from it at start\n"
+		 "  -G, --group-window <int>\n"
+		 "        Microseconds a durable commit may wait for others to share its flush (default=" XSTR(DEFAULT_GROUP_WINDOW) ")\n"
+		 "  -B, --backup <file>\n"
+		 "        Copy the accounts to file over and over during the run, without stopping the transfers\n"
+		 "  -z, --zipf <double>\n"
+		 "        Draw the accounts of transfers from a Zipfian distribution of this theta, in (0, 1) (default=uniform)\n"
 		 );
 	  exit(0);
 	case 'a':
@@ -319,6 +792,57 @@ main(int argc, char **argv)
 	case 'v':
 	  test_verbose = 1;
 	  break;
+	case 'm':
+	  mvcc = 1;
+	  break;
+	case 's':
+	  si = 1;
+	  break;
+	case 'w':
+	  write_through = 1;
+	  break;
+	case 'S':
+	  spin = atoi(optarg);
+	  break;
+	case 'A':
+	  commutative = 1;
+	  break;
+	case 'F':
+	  combining = atoi(optarg);
+	  break;
+	case 'x':
+	  adaptive = 1;
+	  break;
+	case 'L':
+	  resize = 1;
+	  break;
+	case 'V':
+	  visible = 1;
+	  break;
+	case 'P':
+	  durable = optarg;
+	  break;
+	case 'G':
+	  group_window = atoi(optarg);
+	  break;
+	case 'B':
+	  backup = optarg;
+	  break;
+	case 'z':
+	  zipf_theta = atof(optarg);
+	  break;
+	case 'O':
+	  rate = atoll(optarg);
+	  break;
+	case 'p':
+	  phases_path = optarg;
+	  break;
+	case 't':
+	  timeline = optarg;
+	  break;
+	case 'Q':
+	  consumers = atoi(optarg);
+	  break;
 	case '?':
 	  printf("Use -h or --help for help\n");
 	  exit(0);
@@ -337,6 +861,12 @@ main(int argc, char **argv)
   assert(duration >= 0);
   assert(nb_accounts >= 2);
   assert(read_all >= 0 && write_all >= 0 && check >= 0 && check <= 100);
+  assert(zipf_theta >= 0 && zipf_theta < 1);
+  /* modes that cannot run together in the runtime */
+  assert(!(mvcc || si) || !(write_through || adaptive || resize || visible));
+  assert(!write_through || !(adaptive || backup != NULL));
+  assert(!adaptive || !(durable != NULL || backup != NULL));
+  assert(consumers >= 0);
   
   if (test_verbose)
     {
@@ -345,6 +875,7 @@ main(int argc, char **argv)
       printf("Check acc rate : %d\n", check - write_all);
       printf("Transfer rate  : %d\n", 100 - check);
       printf("# Read cores   : %d\n", read_cores);
+      printf("Zipf theta     : %.2f\n", zipf_theta);
     }
   /* normalize percentages to 128 */
 
@@ -353,8 +884,6 @@ main(int argc, char **argv)
   write_all *= normalize;
   read_all *= normalize;
 
-  TM_START();
-
   bank = (bank_t*) malloc(sizeof (bank_t));
   if (bank == NULL)
     {
@@ -370,6 +899,31 @@ main(int argc, char **argv)
     }
 
   bank->size = nb_accounts;
+  bank->last_total = 0;
+  bank->inbox.number = nb_accounts;
+  bank->inbox.balance = 0;
+  bank->closed = 0;
+  if (zipf_theta > 0)
+    {
+      zipf_init(&zipf, nb_accounts, zipf_theta);
+    }
+  if (phases_path != NULL)
+    {
+      /* parked while the step runs fewer */
+      assert(rate == 0 && read_cores == 0);
+      num_threads = phases_read(phases_path, nb_accounts, num_threads);
+    }
+  /* few enough groups that each combiner still batches
+     COMBINING_MIN_BATCH closures when every thread delegates */
+  combining_groups = num_threads / COMBINING_MIN_BATCH;
+  if (combining_groups < 1)
+    {
+      combining_groups = 1;
+    }
+  else if (combining_groups > SSTM_FC_GROUPS)
+    {
+      combining_groups = SSTM_FC_GROUPS;
+    }
 
 	
   {
@@ -381,6 +935,41 @@ main(int argc, char **argv)
       }
   }
 
+  /* recovered by TM_START from the log of the last run */
+  if (durable != NULL)
+    {
+      sstm_durable_enable(durable, group_window);
+      sstm_durable_region(bank->accounts, nb_accounts * sizeof (account_t));
+      sstm_durable_region(&bank->inbox, sizeof (account_t));
+    }
+
+  TM_START();
+  if (mvcc || si)
+    {
+      sstm_mv_enable();
+    }
+  else if (write_through)
+    {
+      sstm_write_through_enable();
+    }
+  else if (adaptive)
+    {
+      sstm_adapt_enable(SSTM_BACKEND_OPTIMISTIC);
+    }
+  if (spin > 0)
+    {
+      sstm_spin_enable(spin);
+    }
+  if (resize)
+    {
+      sstm_resize_enable();
+    }
+  if (backup != NULL)
+    {
+      sstm_snapshot_region(bank->accounts, nb_accounts * sizeof (account_t));
+      sstm_snapshot_region(&bank->inbox, sizeof (account_t));
+    }
+
   uint32_t tot = total(bank, 0);
   if (test_verbose)
     {
@@ -410,8 +999,14 @@ main(int argc, char **argv)
       data[t].nb_checks = 0;
       data[t].nb_read_all = 0;
       data[t].nb_write_all = 0;
+      data[t].nb_delegated = 0;
+      data[t].nb_produced = 0;
+      data[t].nb_consumed = 0;
       data[t].nb_accounts = bank->size;
       data[t].duration = duration;
+      data[t].gap_ns = rate > 0 ? 1e9 * num_threads / rate : 0;
+      data[t].latencies = rate > 0 ? calloc(LATENCY_BUCKETS, sizeof(uint64_t)) : NULL;
+      data[t].nb_late = 0;
       rc = pthread_create(&threads[t], &attr, test, &data[t]);
       if (rc)
 	{
@@ -421,11 +1016,39 @@ main(int argc, char **argv)
         
     }
     
+  thread_data_t cdata[consumers];
+  pthread_t cthreads[consumers];
+  for (t = 0; t < consumers; t++)
+    {
+      memset(&cdata[t], 0, sizeof (thread_data_t));
+      cdata[t].id = num_threads + t;
+      cdata[t].nb_accounts = bank->size;
+      rc = pthread_create(&cthreads[t], &attr, consumer, &cdata[t]);
+      if (rc)
+	{
+	  printf("ERROR; return code from pthread_create() is %d\n", rc);
+	  exit(-1);
+	}
+    }
+
   /* Free attribute and wait for the other threads */
   pthread_attr_destroy(&attr);
 
-  printf(" ZZZzzz %d seconds\n", duration);
-  sleep(duration);
+  double elapsed = duration;
+  if (phases_path != NULL)
+    {
+      elapsed = phases_run(timeline);
+    }
+  else if (backup != NULL)
+    {
+      printf(" ZZZzzz %d seconds\n", duration);
+      backup_loop(duration);
+    }
+  else
+    {
+      printf(" ZZZzzz %d seconds\n", duration);
+      sleep(duration);
+    }
   printf(" Woken up\n");
   asm volatile ("mfence");
   work = 0;
@@ -442,14 +1065,44 @@ main(int argc, char **argv)
 	}
     }
 
+  /* the producers are done: the consumers empty the inbox */
+  if (consumers > 0)
+    {
+      uint64_t produced = 0, consumed = 0, closed_at = now_ns();
+      TM_THREAD_START();
+      close_inbox(bank);
+      TM_THREAD_STOP();
+      for (t = 0; t < consumers; t++)
+	{
+	  pthread_join(cthreads[t], NULL);
+	  consumed += cdata[t].nb_consumed;
+	}
+      for (t = 0; t < num_threads; t++)
+	{
+	  produced += data[t].nb_produced;
+	}
+      printf("# Consumers: %-10zu of %zu units, all back in %.2f ms\n", consumed, produced, (now_ns() - closed_at) / 1e6);
+      if (consumed != produced || bank->inbox.balance != 0 || sstm_meta_global.n_parked != 0)
+	{
+	  printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\tConsumers must take every unit produced and all wake!\n");
+	}
+      assert(consumed == produced && bank->inbox.balance == 0 && sstm_meta_global.n_parked == 0);
+    }
+
+  sstm_print_spin_stats();
+  sstm_adapt_print_stats();
+  sstm_resize_print_stats();
+  sstm_durable_print_stats();
+  sstm_snapshot_print_stats();
+  sstm_retry_print_stats();
   TM_STOP();
 
   if (test_verbose)
     {
       for(t = 0; t < num_threads; t++)
 	{
-	  printf("---Core %ld\n  #transfer   : %zu\n  #checks     : %zu\n  #read-all   : %zu\n  #write-all  : %zu\n",
-		 t, data[t].nb_transfer, data[t].nb_checks, data[t].nb_read_all, data[t].nb_write_all);
+	  printf("---Core %ld\n  #transfer   : %zu\n  #checks     : %zu\n  #read-all   : %zu\n  #write-all  : %zu\n  #delegated  : %zu\n",
+		 t, data[t].nb_transfer, data[t].nb_checks, data[t].nb_read_all, data[t].nb_write_all, data[t].nb_delegated);
 	}
     }
 
@@ -463,7 +1116,11 @@ main(int argc, char **argv)
     }
   assert(tot == 0);
 
-  TM_STATS(duration);
+  TM_STATS(elapsed);
+  if (rate > 0)
+    {
+      print_latencies(data, num_threads, duration);
+    }
 
 
   /* Delete bank and accounts */
@@ -0,0 +1,437 @@
+#include <assert.h>
+#include <getopt.h>
+#include <limits.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sstm.h"
+#include "random.h"
+__thread unsigned long* seeds;
+
+/*
+ * Costs of the STM primitives, in ns per operation, from getticks():
+ * what bank and ll cannot separate. Every measurement runs on one
+ * thread, then on N threads at once on their own data, so that the
+ * second column only shows the cost of the shared metadata (clocks,
+ * lock table), never conflicts. A measurement is the best of a few
+ * batches of iterations, to leave out preemptions.
+ */
+
+#define DEFAULT_NB_THREADS              4
+#define DEFAULT_K                       8
+#define DEFAULT_W                       8
+#define DEFAULT_ITERATIONS              100000
+#define DEFAULT_JSON                    "bench_micro.json"
+#define BATCHES                         5
+#define STRIDE                          8 /* words: one cache line, a stripe of its own */
+
+int k = DEFAULT_K;
+int w = DEFAULT_W;
+int iterations = DEFAULT_ITERATIONS;
+double ticks_per_ns;
+uint64_t ticks_overhead;	/* of a pair of getticks() */
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+/* ################################################################### *
+ * MEASUREMENTS
+ * ################################################################### */
+
+/* ticks per iteration; words is private to the thread. What lives
+   across TX_START is volatile: an abort jumps back into the loop */
+typedef uint64_t (*measure_fn)(volatile uintptr_t* words);
+
+static uint64_t
+tx_empty(volatile uintptr_t* words)
+{
+  uint64_t t0 = getticks();
+  volatile int i;
+  (void) words;
+  for (i = 0; i < iterations; i++)
+    {
+      TX_START();
+      TX_COMMIT();
+    }
+  return (getticks() - t0) / iterations;
+}
+
+static uint64_t
+tx_loads(volatile uintptr_t* words)
+{
+  uint64_t t0 = getticks();
+  volatile uintptr_t sum = 0;
+  volatile int i;
+  int j;
+  for (i = 0; i < iterations; i++)
+    {
+      TX_START();
+      uintptr_t s = 0;
+      for (j = 0; j < k; j++)
+	{
+	  s += TX_LOAD(&words[j * STRIDE]);
+	}
+      TX_COMMIT();
+      sum += s;
+    }
+  assert(sum == 0);
+  return (getticks() - t0) / iterations;
+}
+
+static uint64_t
+tx_stores(volatile uintptr_t* words)
+{
+  uint64_t t0 = getticks();
+  volatile int i;
+  int j;
+  for (i = 0; i < iterations; i++)
+    {
+      TX_START();
+      for (j = 0; j < k; j++)
+	{
+	  TX_STORE(&words[j * STRIDE], 0);
+	}
+      TX_COMMIT();
+    }
+  return (getticks() - t0) / iterations;
+}
+
+/* the loads find the words in the write set */
+static uint64_t
+tx_stores_loads(volatile uintptr_t* words)
+{
+  uint64_t t0 = getticks();
+  volatile uintptr_t sum = 0;
+  volatile int i;
+  int j;
+  for (i = 0; i < iterations; i++)
+    {
+      TX_START();
+      uintptr_t s = 0;
+      for (j = 0; j < k; j++)
+	{
+	  TX_STORE(&words[j * STRIDE], 0);
+	}
+      for (j = 0; j < k; j++)
+	{
+	  s += TX_LOAD(&words[j * STRIDE]);
+	}
+      TX_COMMIT();
+      sum += s;
+    }
+  assert(sum == 0);
+  return (getticks() - t0) / iterations;
+}
+
+/* the commit alone, with w words to write back */
+static uint64_t
+tx_commit(volatile uintptr_t* words)
+{
+  volatile uint64_t ticks = 0;
+  volatile int i;
+  int j;
+  for (i = 0; i < iterations; i++)
+    {
+      TX_START();
+      for (j = 0; j < w; j++)
+	{
+	  TX_STORE(&words[j * STRIDE], 0);
+	}
+      uint64_t t0 = getticks();
+      TX_COMMIT();
+      ticks += getticks() - t0 - ticks_overhead;
+    }
+  return ticks / iterations;
+}
+
+/* k stores, an abort that releases them, and the same k stores again */
+static uint64_t
+tx_abort_retry(volatile uintptr_t* words)
+{
+  uint64_t t0 = getticks();
+  volatile int i;
+  int j;
+  for (i = 0; i < iterations; i++)
+    {
+      volatile int attempt = 0;
+      TX_START();
+      for (j = 0; j < k; j++)
+	{
+	  TX_STORE(&words[j * STRIDE], 0);
+	}
+      if (attempt++ == 0)
+	{
+	  TX_ABORT(1);
+	}
+      TX_COMMIT();
+    }
+  return (getticks() - t0) / iterations;
+}
+
+typedef struct benchmark
+{
+  const char* name;
+  const char* unit;		/* what an op is */
+  measure_fn fn;
+  measure_fn base;		/* subtracted, or NULL */
+  int* per;			/* ops per iteration, or NULL */
+} benchmark_t;
+
+static benchmark_t benchmarks[] =
+  {
+    { "tx_empty", "transaction", tx_empty, NULL, NULL },
+    { "load", "load", tx_loads, tx_empty, &k },
+    { "store", "store", tx_stores, tx_empty, &k },
+    { "load_after_store", "load", tx_stores_loads, tx_stores, &k },
+    { "commit", "commit", tx_commit, NULL, NULL },
+    { "abort_retry", "abort", tx_abort_retry, tx_stores, NULL },
+  };
+
+#define N_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/* the best batch */
+static uint64_t
+best(measure_fn fn, volatile uintptr_t* words)
+{
+  uint64_t min = UINT64_MAX;
+  int b;
+  for (b = 0; b < BATCHES; b++)
+    {
+      uint64_t t = fn(words);
+      if (t < min)
+	{
+	  min = t;
+	}
+    }
+  return min;
+}
+
+/* ns per op of every benchmark, on the calling thread */
+static void
+run_all(volatile uintptr_t* words, double* ns)
+{
+  size_t b;
+  for (b = 0; b < N_BENCHMARKS; b++)
+    {
+      benchmark_t* bm = &benchmarks[b];
+      double ticks = best(bm->fn, words);
+      if (bm->base != NULL)
+	{
+	  ticks -= best(bm->base, words);
+	}
+      if (bm->per != NULL)
+	{
+	  ticks /= *bm->per;
+	}
+      ns[b] = ticks > 0 ? ticks / ticks_per_ns : 0;
+    }
+}
+
+/* ################################################################### *
+ * THREADS
+ * ################################################################### */
+
+typedef struct thread_data
+{
+  double ns[N_BENCHMARKS];
+  pthread_barrier_t* barrier;
+} thread_data_t;
+
+static volatile uintptr_t*
+alloc_words()
+{
+  size_t n = (k > w ? k : w) * STRIDE;
+  volatile uintptr_t* words = memalign(64, n * sizeof(uintptr_t));
+  assert(words != NULL);
+  memset((void*) words, 0, n * sizeof(uintptr_t));
+  return words;
+}
+
+void*
+test(void *data)
+{
+  thread_data_t *d = (thread_data_t *) data;
+  volatile uintptr_t* words = alloc_words();
+
+  TM_THREAD_START();
+  pthread_barrier_wait(d->barrier);
+  run_all(words, d->ns);
+  TM_THREAD_STOP();
+
+  free((void*) words);
+  return NULL;
+}
+
+static void
+calibrate()
+{
+  struct timespec t0, t1, pause = { 0, 10000000 };
+  uint64_t c0, c1, min = UINT64_MAX;
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  c0 = getticks();
+  nanosleep(&pause, NULL);
+  c1 = getticks();
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ticks_per_ns = (double) (c1 - c0) / ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec));
+  for (i = 0; i < 1000; i++)
+    {
+      c0 = getticks();
+      c1 = getticks();
+      if (c1 - c0 < min)
+	{
+	  min = c1 - c0;
+	}
+    }
+  ticks_overhead = min;
+}
+
+int
+main(int argc, char **argv)
+{
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help", no_argument, NULL, 'h'},
+      {"num-threads", required_argument, NULL, 'n'},
+      {"loads", required_argument, NULL, 'k'},
+      {"writes", required_argument, NULL, 'w'},
+      {"iterations", required_argument, NULL, 'i'},
+      {"json", required_argument, NULL, 'j'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int num_threads = DEFAULT_NB_THREADS;
+  char* json = DEFAULT_JSON;
+  int i, c;
+  while (1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hn:k:w:i:j:", long_options, &i);
+
+      if (c == -1)
+	break;
+
+      if (c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch (c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'h':
+	  printf("bench_micro -- costs of the STM primitives\n"
+		 "\n"
+		 "Usage:\n"
+		 "  bench_micro [options...]\n"
+		 "\n"
+		 "Options:\n"
+		 "  -h, --help\n"
+		 "        Print this message\n"
+		 "  -n, --num-threads <int>\n"
+		 "        Threads of the second run, each on its own words (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+		 "  -k, --loads <int>\n"
+		 "        Loads or stores per transaction (default=" XSTR(DEFAULT_K) ")\n"
+		 "  -w, --writes <int>\n"
+		 "        Words written back by the measured commits (default=" XSTR(DEFAULT_W) ")\n"
+		 "  -i, --iterations <int>\n"
+		 "        Transactions per batch (default=" XSTR(DEFAULT_ITERATIONS) ")\n"
+		 "  -j, --json <file>\n"
+		 "        Write the results as json (default=" DEFAULT_JSON ")\n"
+		 );
+	  exit(0);
+	case 'n':
+	  num_threads = atoi(optarg);
+	  break;
+	case 'k':
+	  k = atoi(optarg);
+	  break;
+	case 'w':
+	  w = atoi(optarg);
+	  break;
+	case 'i':
+	  iterations = atoi(optarg);
+	  break;
+	case 'j':
+	  json = optarg;
+	  break;
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  assert(num_threads >= 1 && k >= 1 && w >= 1 && iterations >= 1);
+
+  calibrate();
+  TM_START();
+
+  /* one thread */
+  double single[N_BENCHMARKS];
+  volatile uintptr_t* words = alloc_words();
+  TM_THREAD_START();
+  run_all(words, single);
+  TM_THREAD_STOP();
+  free((void*) words);
+
+  /* n threads, the average */
+  double multi[N_BENCHMARKS] = { 0 };
+  thread_data_t data[num_threads];
+  pthread_t threads[num_threads];
+  pthread_barrier_t barrier;
+  long t;
+  size_t b;
+
+  pthread_barrier_init(&barrier, NULL, num_threads);
+  for (t = 0; t < num_threads; t++)
+    {
+      data[t].barrier = &barrier;
+      if (pthread_create(&threads[t], NULL, test, &data[t]))
+	{
+	  printf("ERROR; pthread_create()\n");
+	  exit(-1);
+	}
+    }
+  for (t = 0; t < num_threads; t++)
+    {
+      pthread_join(threads[t], NULL);
+      for (b = 0; b < N_BENCHMARKS; b++)
+	{
+	  multi[b] += data[t].ns[b] / num_threads;
+	}
+    }
+  pthread_barrier_destroy(&barrier);
+  TM_STOP();
+
+  printf("# %.2f ticks/ns, k=%d, w=%d, %d iterations x %d batches\n", ticks_per_ns, k, w, iterations, BATCHES);
+  printf("%-18s %-12s %-12s %-12s\n", "primitive", "per", "1 thread", "threads");
+  for (b = 0; b < N_BENCHMARKS; b++)
+    {
+      printf("%-18s %-12s %-12.1f %-12.1f\n", benchmarks[b].name, benchmarks[b].unit, single[b], multi[b]);
+    }
+
+  FILE* f = fopen(json, "w");
+  if (f == NULL)
+    {
+      perror(json);
+      exit(1);
+    }
+  fprintf(f, "{\n  \"ticks_per_ns\": %.3f,\n  \"k\": %d,\n  \"w\": %d,\n  \"iterations\": %d,\n  \"threads\": %d,\n",
+	  ticks_per_ns, k, w, iterations, num_threads);
+  fprintf(f, "  \"results\": [\n");
+  for (b = 0; b < N_BENCHMARKS; b++)
+    {
+      fprintf(f, "    { \"name\": \"%s\", \"per\": \"%s\", \"ns_1\": %.2f, \"ns_n\": %.2f }%s\n", benchmarks[b].name,
+	      benchmarks[b].unit, single[b], multi[b], b + 1 < N_BENCHMARKS ? "," : "");
+    }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,282 @@
+#include <assert.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sstm.h"
+#include "random.h"
+__thread unsigned long* seeds;
+
+/*
+ * Hash map version of ll: an operation reads O(1) links instead of O(n).
+ * The table doubles when an insert finds a chain of HT_RESIZE_CHAIN
+ * nodes. Only the base TX_* interface is used, so that the same file also
+ * builds against the global-lock STM (scripts/create_glstm.sh).
+ */
+
+#define HT_INITIAL_BUCKETS              16
+#define HT_RESIZE_CHAIN                 4
+
+/* ################################################################### *
+ * GLOBALS
+ * ################################################################### */
+
+/* TX_FREE clears the first word of a node: the key, which is read
+   outside of the transaction, is not it */
+typedef struct ht_node
+{
+  struct ht_node* next;
+  size_t key;
+} ht_node_t;
+
+/* only the buckets change: a transaction that still reads an old table
+   after a resize is invalidated by the nodes the resize relinked */
+typedef struct ht_table
+{
+  size_t n_buckets;		/* a power of 2 */
+  size_t shift;			/* 64 - log2(n_buckets) */
+  struct ht_table* retired;	/* the previous one, freed at the end */
+  ht_node_t* buckets[];
+} ht_table_t;
+
+typedef struct ht
+{
+  ht_table_t* table;		/* replaced by a resize */
+  size_t n_resizes;
+} ht_t;
+
+static ht_t* set;
+
+/* Fibonacci hashing: consecutive keys land in different buckets */
+static inline ht_node_t**
+ht_bucket(ht_table_t* table, size_t key)
+{
+  return &table->buckets[(key * 0x9E3779B97F4A7C15ULL) >> table->shift];
+}
+
+static ht_table_t*
+ht_table_new(size_t n_buckets, ht_table_t* retired)
+{
+  ht_table_t* table = TX_MALLOC(sizeof(ht_table_t) + n_buckets * sizeof(ht_node_t*));
+  assert(table != NULL);
+  memset(table->buckets, 0, n_buckets * sizeof(ht_node_t*));
+  table->n_buckets = n_buckets;
+  for (table->shift = 64; n_buckets > 1; n_buckets >>= 1)
+    {
+      table->shift--;
+    }
+  table->retired = retired;
+  return table;
+}
+
+/* doubles the table, unless another thread already did: every node is
+   relinked into the new buckets in one transaction */
+static void
+ht_resize(ht_t* set, ht_table_t* seen)
+{
+  size_t i;
+
+  TX_START();
+  ht_table_t* old = (ht_table_t*) TX_LOAD(&set->table);
+  if (old == seen)
+    {
+      /* locks the table pointer first: the operations that start from
+	 now on abort on it instead of invalidating the resize */
+      TX_STORE(&set->table, old);
+      ht_table_t* new = ht_table_new(2 * old->n_buckets, old);
+      for (i = 0; i < old->n_buckets; i++)
+	{
+	  ht_node_t* cur = (ht_node_t*) TX_LOAD(&old->buckets[i]);
+	  while (cur != NULL)
+	    {
+	      ht_node_t* nxt = (ht_node_t*) TX_LOAD(&cur->next);
+	      ht_node_t** bucket = ht_bucket(new, cur->key);
+	      TX_STORE(&cur->next, *bucket);
+	      *bucket = cur;	/* not visible before the commit */
+	      cur = nxt;
+	    }
+	}
+      TX_STORE(&set->table, new);
+      TX_STORE(&set->n_resizes, TX_LOAD(&set->n_resizes) + 1);
+    }
+  TX_COMMIT();
+}
+
+int
+ht_insert(ht_t* set, size_t key)
+{
+  int ret = 0;
+  size_t length;
+  ht_table_t* table;
+
+  TX_START();
+  table = (ht_table_t*) TX_LOAD(&set->table);
+  ht_node_t** bucket = ht_bucket(table, key);
+  ht_node_t* cur = (ht_node_t*) TX_LOAD(bucket);
+  length = 0;
+
+  while (cur != NULL && cur->key != key)
+    {
+      length++;
+      cur = (ht_node_t*) TX_LOAD(&cur->next);
+    }
+
+  if (cur == NULL)
+    {
+      ht_node_t* new = TX_MALLOC(sizeof(ht_node_t));
+      assert(new != NULL);
+      new->key = key;
+      new->next = (ht_node_t*) TX_LOAD(bucket);
+      TX_STORE(bucket, new);
+      ret = 1;
+    }
+  else
+    {
+      ret = 0;
+    }
+
+  TX_COMMIT();
+
+  if (ret && length >= HT_RESIZE_CHAIN)
+    {
+      ht_resize(set, table);
+    }
+  return ret;
+}
+
+int
+ht_delete(ht_t* set, size_t key)
+{
+  int ret = 0;
+
+  TX_START();
+  ht_table_t* table = (ht_table_t*) TX_LOAD(&set->table);
+  ht_node_t** link = ht_bucket(table, key);
+  ht_node_t* cur = (ht_node_t*) TX_LOAD(link);
+
+  while (cur != NULL && cur->key != key)
+    {
+      link = &cur->next;
+      cur = (ht_node_t*) TX_LOAD(link);
+    }
+
+  if (cur == NULL)
+    {
+      ret = 0;
+    }
+  else
+    {
+      TX_STORE(link, TX_LOAD(&cur->next));
+      TX_FREE(cur);
+      ret = 1;
+    }
+
+  TX_COMMIT();
+  return ret;
+}
+
+int
+ht_search(ht_t* set, size_t key)
+{
+  int ret = 0;
+
+  TX_START();
+  ht_table_t* table = (ht_table_t*) TX_LOAD(&set->table);
+  ht_node_t* cur = (ht_node_t*) TX_LOAD(ht_bucket(table, key));
+
+  while (cur != NULL && cur->key != key)
+    {
+      cur = (ht_node_t*) TX_LOAD(&cur->next);
+    }
+
+  if (cur == NULL)
+    {
+      ret = 0;
+    }
+  else
+    {
+      ret = 1;
+    }
+
+  TX_COMMIT();
+  return ret;
+}
+
+size_t
+ht_size(ht_t* set)
+{
+  size_t size = 0, i;
+  TX_START();
+  size = 0;
+  ht_table_t* table = (ht_table_t*) TX_LOAD(&set->table);
+  for (i = 0; i < table->n_buckets; i++)
+    {
+      ht_node_t* cur = (ht_node_t*) TX_LOAD(&table->buckets[i]);
+      while (cur != NULL)
+	{
+	  size++;
+	  cur = (ht_node_t*) TX_LOAD(&cur->next);
+	}
+    }
+  TX_COMMIT();
+
+  return size;
+}
+
+
+
+/* ################################################################### *
+ * STRESS TEST
+ * ################################################################### */
+
+/* small, so that filling it resizes it */
+static ht_t*
+ht_new(uint32_t size)
+{
+  uint32_t i;
+  ht_t* set = (ht_t*) malloc(sizeof(ht_t));
+  if (set == NULL)
+    {
+      printf("malloc set");
+      exit(1);
+    }
+  set->n_resizes = 0;
+  TX_START();
+  TX_STORE(&set->table, ht_table_new(HT_INITIAL_BUCKETS, NULL));
+  TX_COMMIT();
+
+  for (i = 0; i < size; i++)
+    {
+      ht_insert(set, i);
+    }
+  return set;
+}
+
+static void
+ht_print_stats(ht_t* set)
+{
+  printf("# Resizes: %-10zu %zu buckets\n", set->n_resizes, set->table->n_buckets);
+}
+
+static void
+ht_free(ht_t* set)
+{
+  while (set->table != NULL)
+    {
+      ht_table_t* retired = set->table->retired;
+      free(set->table);
+      set->table = retired;
+    }
+  free(set);
+}
+
+#define SET_NAME                        "hash map"
+#define SET_PROG                        "ht"
+#define SET_T                           ht_t
+#define SET_OP(op)                      ht_##op
+#define SET_PRINT_STATS(set)            ht_print_stats(set)
+#include "set_bench.h"
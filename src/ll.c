@@ -7,6 +7,7 @@
 
 #include "sstm.h"
 #include "random.h"
+#include "phases.h"
 __thread unsigned long* seeds; 
 
 /*
@@ -21,9 +22,20 @@ __thread unsigned long* seeds;
 #define DEFAULT_NB_THREADS              1
 #define DEFAULT_PERC_UPDATES            20
 #define DEFAULT_VERBOSE                 0
+#define DEFAULT_ELASTIC                 0
+#define DEFAULT_ADAPTIVE                0
+#define DEFAULT_RESIZE                  0
+#define DEFAULT_ZIPF                    0
 
 int delay = DEFAULT_DELAY;
 int test_verbose = DEFAULT_VERBOSE;
+int elastic = DEFAULT_ELASTIC;
+int adaptive = DEFAULT_ADAPTIVE;
+int resize = DEFAULT_RESIZE;
+double zipf_theta = DEFAULT_ZIPF;
+zipf_t zipf;
+char* phases_path = NULL;
+char* timeline = "timeline.csv";
 int argc;
 char **argv;
 
@@ -47,19 +59,36 @@ typedef struct ll
 
 static ll_t* list;
 
+/* elastic traversal: once the next link is read, the link that led to
+   the node we left is released, so only the last links are validated */
+static inline void
+ll_release(node_t** link)
+{
+  if (elastic && link != NULL)
+    {
+      TX_RELEASE(link);
+    }
+}
+
 int 
 ll_insert(ll_t* list, size_t key) 
 {
   int ret = 0;
 
   TX_START();
-  node_t* cur = (node_t*) TX_LOAD(&list->head);
+  node_t** pred_link = NULL;
+  node_t** cur_link = &list->head;
+  node_t* cur = (node_t*) TX_LOAD(cur_link);
   node_t* pred = NULL;
 
   while (cur != NULL && cur->key < key)
     {
+      node_t** left = pred_link;
+      pred_link = cur_link;
       pred = cur;
-      cur = (node_t*) TX_LOAD(&cur->next);//
+      cur_link = &cur->next;
+      cur = (node_t*) TX_LOAD(cur_link);
+      ll_release(left);
     }
 
   if (cur == NULL || cur->key != key)
@@ -93,13 +122,19 @@ ll_delete(ll_t* list, size_t key)
   int ret = 0;
 
   TX_START();
-  node_t* cur = (node_t*) TX_LOAD(&list->head);
+  node_t** pred_link = NULL;
+  node_t** cur_link = &list->head;
+  node_t* cur = (node_t*) TX_LOAD(cur_link);
   node_t* pred = NULL;
 
   while (cur != NULL && cur->key < key)
     {
+      node_t** left = pred_link;
+      pred_link = cur_link;
       pred = cur;
-      cur = (node_t*) TX_LOAD(&cur->next);
+      cur_link = &cur->next;
+      cur = (node_t*) TX_LOAD(cur_link);
+      ll_release(left);
     }
 
   if (cur == NULL || cur->key != key)
@@ -108,7 +143,12 @@ ll_delete(ll_t* list, size_t key)
     }
   else
     {
-      node_t* nxt = cur->next;
+      node_t* nxt = (node_t*) TX_LOAD(&cur->next);
+      if (elastic)
+	{
+	  /* traversals standing on cur have its next link in their window */
+	  TX_STORE(&cur->next, nxt);
+	}
       if (pred != NULL)
 	{
 	  TX_STORE(&pred->next, nxt);
@@ -131,11 +171,17 @@ ll_search(ll_t* list, size_t key)
   int ret = 0;
 
   TX_START();
-  node_t* cur = (node_t*) TX_LOAD(&list->head);
+  node_t** pred_link = NULL;
+  node_t** cur_link = &list->head;
+  node_t* cur = (node_t*) TX_LOAD(cur_link);
 
   while (cur != NULL && cur->key < key)
     {
-      cur = (node_t*) TX_LOAD(&cur->next);
+      node_t** left = pred_link;
+      pred_link = cur_link;
+      cur_link = &cur->next;
+      cur = (node_t*) TX_LOAD(cur_link);
+      ll_release(left);
     }
 
   if (cur == NULL || cur->key != key)
@@ -211,8 +257,28 @@ test(void *data)
   /* BARRIER; */
   while(work)
     {
+      /* a phase script changes the mix and the threads as it goes */
+      phase_t* phase = phase_current();
+      if (phase != NULL)
+	{
+	  if (!phase_wait(d->id))
+	    {
+	      break;
+	    }
+	  lim_search = INT_MAX - phase->update * (INT_MAX / 100.0);
+	  lim_insert = lim_search + (INT_MAX - lim_search) / 2;
+	}
+
       int op = (int) fast_rand();
-      uint32_t key = fast_rand() % rand_max;
+      uint32_t key;
+      if (phase != NULL)
+	{
+	  key = phase_key(phase, rand_max);
+	}
+      else
+	{
+	  key = zipf_theta > 0 ? zipf_key(&zipf) : fast_rand() % rand_max;
+	}
 
       if (op < lim_search)
 	{
@@ -254,11 +320,18 @@ main(int argc, char **argv)
       {"write-all-rate", required_argument, NULL, 'w'},
       {"write-threads", required_argument, NULL, 'W'},
       {"verbose", no_argument, NULL, 'v'},
+      {"elastic", no_argument, NULL, 'e'},
+      {"adaptive", no_argument, NULL, 'x'},
+      {"resize", no_argument, NULL, 'L'},
+      {"zipf", required_argument, NULL, 'z'},
+      {"phases", required_argument, NULL, 'p'},
+      {"timeline", required_argument, NULL, 't'},
       {NULL, 0, NULL, 0}
     };
 
 
-  static uint32_t duration, perc_updates, size, num_threads;
+  static int duration;
+  static uint32_t perc_updates, size, num_threads;
 
   duration = DEFAULT_DURATION;
   perc_updates = DEFAULT_PERC_UPDATES;
@@ -269,7 +342,7 @@ main(int argc, char **argv)
   while (1)
     {
       i = 0;
-      c = getopt_long(argc, argv, "hn:i:d:r:u::v", long_options, &i);
+      c = getopt_long(argc, argv, "hn:i:d:r:u::vexLz:p:t:", long_options, &i);
 
       if (c == -1)
 	break;
@@ -297,6 +370,18 @@ main(int argc, char **argv)
 		 "        Test duration in seconds (0=infinite, default=" XSTR(DEFAULT_DURATION) ")\n"
 		 "  -u, --update <int>\n"
 		 "        Percentage of update transactions (default=" XSTR(DEFAULT_PERC_UPDATES) ")\n"
+		 "  -e, --elastic\n"
+		 "        Elastic traversals: only the last two links are validated\n"
+		 "  -x, --adaptive\n"
+		 "        Switch between the optimistic, global-lock and NOrec backends at runtime\n"
+		 "  -L, --resize\n"
+		 "        Resize the lock table at runtime from the rate of false conflicts\n"
+		 "  -z, --zipf <double>\n"
+		 "        Draw the keys from a Zipfian distribution of this theta, in (0, 1) (default=uniform)\n"
+		 "  -p, --phases <file>\n"
+		 "        Run the steps of a phase script instead of -d: lines of <seconds> <read-all %%> <update %%> <zipf theta> <threads>\n"
+		 "  -t, --timeline <file>\n"
+		 "        Commit and abort rates every " XSTR(PHASES_SAMPLE_MS) "ms of a phase script, as csv (default=timeline.csv)\n"
 		 );
 	  exit(0);
 	case 'i':
@@ -314,6 +399,24 @@ main(int argc, char **argv)
 	case 'v':
 	  test_verbose = 1;
 	  break;
+	case 'e':
+	  elastic = 1;
+	  break;
+	case 'x':
+	  adaptive = 1;
+	  break;
+	case 'L':
+	  resize = 1;
+	  break;
+	case 'z':
+	  zipf_theta = atof(optarg);
+	  break;
+	case 'p':
+	  phases_path = optarg;
+	  break;
+	case 't':
+	  timeline = optarg;
+	  break;
 	case '?':
 	  printf("Use -h or --help for help\n");
 	  exit(0);
@@ -326,18 +429,36 @@ main(int argc, char **argv)
   assert(duration >= 0);
   assert(size >= 2);
   assert(perc_updates <= 100);
+  assert(zipf_theta >= 0 && zipf_theta < 1);
 
   if (test_verbose)
     {
       printf("Initial size   : %d\n", size);
       printf("Duration       : %d s\n", duration);
       printf("Updates        : %d%%\n", perc_updates);
+      printf("Zipf theta     : %.2f\n", zipf_theta);
+    }
+  if (zipf_theta > 0)
+    {
+      zipf_init(&zipf, 2 * size, zipf_theta);
+    }
+  if (phases_path != NULL)
+    {
+      num_threads = phases_read(phases_path, 2 * size, num_threads);
     }
   /* normalize percentages to 128 */
 
   perc_updates *= (INT_MAX / 100.0);
 
   TM_START();
+  if (adaptive)
+    {
+      sstm_adapt_enable(SSTM_BACKEND_OPTIMISTIC);
+    }
+  if (resize)
+    {
+      sstm_resize_enable();
+    }
   TM_THREAD_START();
 
   list = (ll_t*) malloc(sizeof(ll_t));
@@ -394,8 +515,16 @@ main(int argc, char **argv)
   /* Free attribute and wait for the other threads */
   pthread_attr_destroy(&attr);
 
-  printf(" ZZZzzz %d seconds\n", duration);
-  sleep(duration);
+  double elapsed = duration;
+  if (phases_path != NULL)
+    {
+      elapsed = phases_run(timeline);
+    }
+  else
+    {
+      printf(" ZZZzzz %d seconds\n", duration);
+      sleep(duration);
+    }
   printf(" Woken up\n");
   asm volatile ("mfence");
   work = 0;
@@ -463,7 +592,9 @@ main(int argc, char **argv)
 	 
 
 
-  TM_STATS(duration);
+  TM_STATS(elapsed);
+  sstm_adapt_print_stats();
+  sstm_resize_print_stats();
   TM_THREAD_STOP();
   TM_STOP();
 
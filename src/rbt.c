@@ -0,0 +1,463 @@
+#include <assert.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sstm.h"
+#include "random.h"
+__thread unsigned long* seeds;
+
+/*
+ * Red-black tree version of ll: an operation reads O(log n) nodes
+ * instead of O(n), and an update rebalances the tree in the same
+ * transaction, which therefore writes a few nodes near the root. Only the base TX_* interface is used, so that the same file also
+ * builds against the global-lock STM (scripts/create_glstm.sh).
+ */
+
+
+/* ################################################################### *
+ * GLOBALS
+ * ################################################################### */
+
+/* TX_FREE clears the first word of a node: the key, which is read
+   outside of the transaction, is not it. Deletes relink nodes instead
+   of moving keys, so the key of a node never changes */
+typedef struct rb_node
+{
+  struct rb_node* left;
+  struct rb_node* right;
+  struct rb_node* parent;
+  uintptr_t color;
+  size_t key;
+} rb_node_t;
+
+typedef struct rb
+{
+  rb_node_t* root;
+} rb_t;
+
+static rb_t* set;
+
+enum { RB_RED, RB_BLACK };
+
+/* the fields of the nodes, read and written in the transaction; a NULL
+   leaf is black */
+#define LEFT(n)                         ((rb_node_t*) TX_LOAD(&(n)->left))
+#define RIGHT(n)                        ((rb_node_t*) TX_LOAD(&(n)->right))
+#define PARENT(n)                       ((rb_node_t*) TX_LOAD(&(n)->parent))
+#define COLOR(n)                        ((n) == NULL ? RB_BLACK : TX_LOAD(&(n)->color))
+#define SET_LEFT(n, v)                  TX_STORE(&(n)->left, v)
+#define SET_RIGHT(n, v)                 TX_STORE(&(n)->right, v)
+#define SET_PARENT(n, v)                TX_STORE(&(n)->parent, v)
+
+/* a store locks the stripe: skip those that write the same color */
+static inline void
+rb_set_color(rb_node_t* n, uintptr_t color)
+{
+  if (COLOR(n) != color)
+    {
+      TX_STORE(&n->color, color);
+    }
+}
+
+/* v takes the place of u under the parent of u */
+static void
+rb_replace(rb_t* set, rb_node_t* u, rb_node_t* v)
+{
+  rb_node_t* up = PARENT(u);
+  if (up == NULL)
+    {
+      TX_STORE(&set->root, v);
+    }
+  else if (u == LEFT(up))
+    {
+      SET_LEFT(up, v);
+    }
+  else
+    {
+      SET_RIGHT(up, v);
+    }
+  if (v != NULL)
+    {
+      SET_PARENT(v, up);
+    }
+}
+
+static void
+rb_rotate_left(rb_t* set, rb_node_t* x)
+{
+  rb_node_t* y = RIGHT(x);
+  rb_node_t* yl = LEFT(y);
+  SET_RIGHT(x, yl);
+  if (yl != NULL)
+    {
+      SET_PARENT(yl, x);
+    }
+  rb_replace(set, x, y);
+  SET_LEFT(y, x);
+  SET_PARENT(x, y);
+}
+
+static void
+rb_rotate_right(rb_t* set, rb_node_t* x)
+{
+  rb_node_t* y = LEFT(x);
+  rb_node_t* yr = RIGHT(y);
+  SET_LEFT(x, yr);
+  if (yr != NULL)
+    {
+      SET_PARENT(yr, x);
+    }
+  rb_replace(set, x, y);
+  SET_RIGHT(y, x);
+  SET_PARENT(x, y);
+}
+
+static void
+rb_insert_fixup(rb_t* set, rb_node_t* z)
+{
+  rb_node_t* p;
+
+  while ((p = PARENT(z)) != NULL && COLOR(p) == RB_RED)
+    {
+      rb_node_t* g = PARENT(p);	/* p is red: not the root */
+      if (p == LEFT(g))
+	{
+	  rb_node_t* y = RIGHT(g);
+	  if (COLOR(y) == RB_RED)
+	    {
+	      rb_set_color(p, RB_BLACK);
+	      rb_set_color(y, RB_BLACK);
+	      rb_set_color(g, RB_RED);
+	      z = g;
+	      continue;
+	    }
+	  if (z == RIGHT(p))
+	    {
+	      z = p;
+	      rb_rotate_left(set, z);
+	      p = PARENT(z);
+	    }
+	  rb_set_color(p, RB_BLACK);
+	  rb_set_color(g, RB_RED);
+	  rb_rotate_right(set, g);
+	}
+      else
+	{
+	  rb_node_t* y = LEFT(g);
+	  if (COLOR(y) == RB_RED)
+	    {
+	      rb_set_color(p, RB_BLACK);
+	      rb_set_color(y, RB_BLACK);
+	      rb_set_color(g, RB_RED);
+	      z = g;
+	      continue;
+	    }
+	  if (z == LEFT(p))
+	    {
+	      z = p;
+	      rb_rotate_right(set, z);
+	      p = PARENT(z);
+	    }
+	  rb_set_color(p, RB_BLACK);
+	  rb_set_color(g, RB_RED);
+	  rb_rotate_left(set, g);
+	}
+    }
+  rb_set_color((rb_node_t*) TX_LOAD(&set->root), RB_BLACK);
+}
+
+/* x, possibly a NULL leaf under xp, has one black too few */
+static void
+rb_delete_fixup(rb_t* set, rb_node_t* x, rb_node_t* xp)
+{
+  while (x != (rb_node_t*) TX_LOAD(&set->root) && COLOR(x) == RB_BLACK)
+    {
+      if (x == LEFT(xp))
+	{
+	  rb_node_t* w = RIGHT(xp);
+	  if (COLOR(w) == RB_RED)
+	    {
+	      rb_set_color(w, RB_BLACK);
+	      rb_set_color(xp, RB_RED);
+	      rb_rotate_left(set, xp);
+	      w = RIGHT(xp);
+	    }
+	  if (COLOR(LEFT(w)) == RB_BLACK && COLOR(RIGHT(w)) == RB_BLACK)
+	    {
+	      rb_set_color(w, RB_RED);
+	      x = xp;
+	      xp = PARENT(x);
+	      continue;
+	    }
+	  if (COLOR(RIGHT(w)) == RB_BLACK)
+	    {
+	      rb_set_color(LEFT(w), RB_BLACK);
+	      rb_set_color(w, RB_RED);
+	      rb_rotate_right(set, w);
+	      w = RIGHT(xp);
+	    }
+	  rb_set_color(w, COLOR(xp));
+	  rb_set_color(xp, RB_BLACK);
+	  rb_set_color(RIGHT(w), RB_BLACK);
+	  rb_rotate_left(set, xp);
+	}
+      else
+	{
+	  rb_node_t* w = LEFT(xp);
+	  if (COLOR(w) == RB_RED)
+	    {
+	      rb_set_color(w, RB_BLACK);
+	      rb_set_color(xp, RB_RED);
+	      rb_rotate_right(set, xp);
+	      w = LEFT(xp);
+	    }
+	  if (COLOR(LEFT(w)) == RB_BLACK && COLOR(RIGHT(w)) == RB_BLACK)
+	    {
+	      rb_set_color(w, RB_RED);
+	      x = xp;
+	      xp = PARENT(x);
+	      continue;
+	    }
+	  if (COLOR(LEFT(w)) == RB_BLACK)
+	    {
+	      rb_set_color(RIGHT(w), RB_BLACK);
+	      rb_set_color(w, RB_RED);
+	      rb_rotate_left(set, w);
+	      w = LEFT(xp);
+	    }
+	  rb_set_color(w, COLOR(xp));
+	  rb_set_color(xp, RB_BLACK);
+	  rb_set_color(LEFT(w), RB_BLACK);
+	  rb_rotate_right(set, xp);
+	}
+      x = (rb_node_t*) TX_LOAD(&set->root);
+    }
+  if (x != NULL)
+    {
+      rb_set_color(x, RB_BLACK);
+    }
+}
+
+/* the node of key, or NULL and the node it would hang from */
+static rb_node_t*
+rb_find(rb_t* set, size_t key, rb_node_t** parent)
+{
+  rb_node_t* cur = (rb_node_t*) TX_LOAD(&set->root);
+  rb_node_t* p = NULL;
+
+  while (cur != NULL && cur->key != key)
+    {
+      p = cur;
+      cur = key < cur->key ? LEFT(cur) : RIGHT(cur);
+    }
+  if (parent != NULL)
+    {
+      *parent = p;
+    }
+  return cur;
+}
+
+int
+rb_insert(rb_t* set, size_t key)
+{
+  int ret = 0;
+
+  TX_START();
+  rb_node_t* parent;
+  rb_node_t* cur = rb_find(set, key, &parent);
+
+  if (cur == NULL)
+    {
+      rb_node_t* new = TX_MALLOC(sizeof(rb_node_t));
+      assert(new != NULL);
+      new->key = key;
+      new->left = NULL;
+      new->right = NULL;
+      new->parent = parent;
+      new->color = RB_RED;
+      if (parent == NULL)
+	{
+	  TX_STORE(&set->root, new);
+	}
+      else if (key < parent->key)
+	{
+	  SET_LEFT(parent, new);
+	}
+      else
+	{
+	  SET_RIGHT(parent, new);
+	}
+      rb_insert_fixup(set, new);
+      ret = 1;
+    }
+  else
+    {
+      ret = 0;
+    }
+
+  TX_COMMIT();
+  return ret;
+}
+
+int
+rb_delete(rb_t* set, size_t key)
+{
+  int ret = 0;
+
+  TX_START();
+  rb_node_t* z = rb_find(set, key, NULL);
+
+  if (z == NULL)
+    {
+      ret = 0;
+    }
+  else
+    {
+      rb_node_t* zl = LEFT(z);
+      rb_node_t* zr = RIGHT(z);
+      rb_node_t* x;
+      rb_node_t* xp;
+      uintptr_t removed = COLOR(z);
+
+      if (zl == NULL || zr == NULL)
+	{
+	  x = zl != NULL ? zl : zr;
+	  xp = PARENT(z);
+	  rb_replace(set, z, x);
+	}
+      else
+	{
+	  /* the successor y takes the place of z */
+	  rb_node_t* y = zr;
+	  rb_node_t* yl;
+	  while ((yl = LEFT(y)) != NULL)
+	    {
+	      y = yl;
+	    }
+	  removed = COLOR(y);
+	  x = RIGHT(y);
+	  if (y == zr)
+	    {
+	      xp = y;
+	    }
+	  else
+	    {
+	      xp = PARENT(y);
+	      rb_replace(set, y, x);
+	      SET_RIGHT(y, zr);
+	      SET_PARENT(zr, y);
+	    }
+	  rb_replace(set, z, y);
+	  SET_LEFT(y, zl);
+	  SET_PARENT(zl, y);
+	  rb_set_color(y, COLOR(z));
+	}
+      if (removed == RB_BLACK)
+	{
+	  rb_delete_fixup(set, x, xp);
+	}
+      TX_FREE(z);
+      ret = 1;
+    }
+
+  TX_COMMIT();
+  return ret;
+}
+
+int
+rb_search(rb_t* set, size_t key)
+{
+  int ret = 0;
+
+  TX_START();
+  rb_node_t* cur = rb_find(set, key, NULL);
+
+  if (cur == NULL)
+    {
+      ret = 0;
+    }
+  else
+    {
+      ret = 1;
+    }
+
+  TX_COMMIT();
+  return ret;
+}
+
+/* the nodes under n, checking the order and the colors on the way:
+   returns their black height */
+static size_t
+rb_check(rb_node_t* n, size_t lo, size_t hi, size_t* size)
+{
+  size_t l, r;
+
+  if (n == NULL)
+    {
+      return 1;
+    }
+  assert(n->key >= lo && n->key <= hi);
+  rb_node_t* nl = LEFT(n);
+  rb_node_t* nr = RIGHT(n);
+  assert(COLOR(n) == RB_BLACK || (COLOR(nl) == RB_BLACK && COLOR(nr) == RB_BLACK));
+  assert(nl == NULL || PARENT(nl) == n);
+  assert(nr == NULL || PARENT(nr) == n);
+  (*size)++;
+  l = rb_check(nl, lo, n->key > 0 ? n->key - 1 : 0, size);
+  r = rb_check(nr, n->key + 1, hi, size);
+  assert(l == r);
+  return l + (COLOR(n) == RB_BLACK);
+}
+
+size_t
+rb_size(rb_t* set)
+{
+  size_t size = 0;
+  TX_START();
+  size = 0;
+  rb_check((rb_node_t*) TX_LOAD(&set->root), 0, SIZE_MAX, &size);
+  TX_COMMIT();
+
+  return size;
+}
+
+
+
+/* ################################################################### *
+ * STRESS TEST
+ * ################################################################### */
+
+static rb_t*
+rb_new(uint32_t size)
+{
+  uint32_t i;
+  rb_t* set = (rb_t*) malloc(sizeof(rb_t));
+  if (set == NULL)
+    {
+      printf("malloc set");
+      exit(1);
+    }
+  set->root = NULL;
+
+  for (i = 0; i < size; i++)
+    {
+      rb_insert(set, i);
+    }
+  return set;
+}
+
+static void
+rb_free(rb_t* set)
+{
+  free(set);
+}
+
+#define SET_NAME                        "red-black tree"
+#define SET_PROG                        "rbt"
+#define SET_T                           rb_t
+#define SET_OP(op)                      rb_##op
+#include "set_bench.h"
@@ -0,0 +1,228 @@
+#include <assert.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sstm.h"
+#include "random.h"
+__thread unsigned long* seeds;
+
+/*
+ * Skip list version of ll: an operation reads O(log n) links instead of
+ * O(n). Only the base TX_* interface is used, so that the same file also
+ * builds against the global-lock STM (scripts/create_glstm.sh).
+ */
+
+#define SL_MAX_LEVEL                    32
+
+/* ################################################################### *
+ * GLOBALS
+ * ################################################################### */
+
+/* TX_FREE clears the first word of a node: the key, which is read
+   outside of the transaction, is not it */
+typedef struct sl_node
+{
+  size_t toplevel;
+  size_t key;
+  struct sl_node* next[];
+} sl_node_t;
+
+typedef struct sl
+{
+  sl_node_t* head;		/* sentinel with max_level links, no key */
+  size_t max_level;
+} sl_t;
+
+static sl_t* set;
+
+/* 1 + the number of heads before the first tail */
+static size_t
+sl_random_level(sl_t* set)
+{
+  size_t level = 1;
+  while (level < set->max_level && (fast_rand() & 1))
+    {
+      level++;
+    }
+  return level;
+}
+
+/* the last node before key and the one after it, on every level */
+static sl_node_t*
+sl_find(sl_t* set, size_t key, sl_node_t** preds, sl_node_t** succs)
+{
+  sl_node_t* pred = set->head;
+  sl_node_t* cur = NULL;
+  int i;
+
+  for (i = set->max_level - 1; i >= 0; i--)
+    {
+      cur = (sl_node_t*) TX_LOAD(&pred->next[i]);
+      while (cur != NULL && cur->key < key)
+	{
+	  pred = cur;
+	  cur = (sl_node_t*) TX_LOAD(&cur->next[i]);
+	}
+      if (preds != NULL)
+	{
+	  preds[i] = pred;
+	  succs[i] = cur;
+	}
+    }
+  return cur;
+}
+
+int
+sl_insert(sl_t* set, size_t key)
+{
+  sl_node_t* preds[SL_MAX_LEVEL];
+  sl_node_t* succs[SL_MAX_LEVEL];
+  int ret = 0;
+
+  TX_START();
+  sl_node_t* cur = sl_find(set, key, preds, succs);
+
+  if (cur == NULL || cur->key != key)
+    {
+      size_t i, level = sl_random_level(set);
+      sl_node_t* new = TX_MALLOC(sizeof(sl_node_t) + level * sizeof(sl_node_t*));
+      assert(new != NULL);
+      new->toplevel = level;
+      new->key = key;
+      for (i = 0; i < level; i++)
+	{
+	  new->next[i] = succs[i];
+	}
+      for (i = 0; i < level; i++)
+	{
+	  TX_STORE(&preds[i]->next[i], new);
+	}
+      ret = 1;
+    }
+  else
+    {
+      ret = 0;
+    }
+
+  TX_COMMIT();
+  return ret;
+}
+
+int
+sl_delete(sl_t* set, size_t key)
+{
+  sl_node_t* preds[SL_MAX_LEVEL];
+  sl_node_t* succs[SL_MAX_LEVEL];
+  int ret = 0;
+
+  TX_START();
+  sl_node_t* cur = sl_find(set, key, preds, succs);
+
+  if (cur == NULL || cur->key != key)
+    {
+      ret = 0;
+    }
+  else
+    {
+      size_t i;
+      for (i = 0; i < cur->toplevel; i++)
+	{
+	  sl_node_t* nxt = (sl_node_t*) TX_LOAD(&cur->next[i]);
+	  TX_STORE(&preds[i]->next[i], nxt);
+	}
+      TX_FREE(cur);
+      ret = 1;
+    }
+
+  TX_COMMIT();
+  return ret;
+}
+
+int
+sl_search(sl_t* set, size_t key)
+{
+  int ret = 0;
+
+  TX_START();
+  sl_node_t* cur = sl_find(set, key, NULL, NULL);
+
+  if (cur == NULL || cur->key != key)
+    {
+      ret = 0;
+    }
+  else
+    {
+      ret = 1;
+    }
+
+  TX_COMMIT();
+  return ret;
+}
+
+size_t
+sl_size(sl_t* set)
+{
+  size_t size = 0;
+  TX_START();
+  size = 0;
+  sl_node_t* cur = (sl_node_t*) TX_LOAD(&set->head->next[0]);
+  while (cur != NULL)
+    {
+      size++;
+      cur = (sl_node_t*) TX_LOAD(&cur->next[0]);
+    }
+  TX_COMMIT();
+
+  return size;
+}
+
+
+
+/* ################################################################### *
+ * STRESS TEST
+ * ################################################################### */
+
+/* log2 of the key range; shuffled, so that the levels do not follow
+   the keys */
+static sl_t*
+sl_new(uint32_t size)
+{
+  uint32_t i;
+  sl_t* set = (sl_t*) malloc(sizeof(sl_t));
+  if (set == NULL)
+    {
+      printf("malloc set");
+      exit(1);
+    }
+  set->max_level = 1;
+  while (set->max_level < SL_MAX_LEVEL && (2UL * size) >> set->max_level)
+    {
+      set->max_level++;
+    }
+  set->head = (sl_node_t*) calloc(1, sizeof(sl_node_t) + set->max_level * sizeof(sl_node_t*));
+  set->head->toplevel = set->max_level;
+
+  for (i = 0; i < size; i++)
+    {
+      while (!sl_insert(set, fast_rand() % (2 * size)))
+	;
+    }
+  return set;
+}
+
+static void
+sl_free(sl_t* set)
+{
+  free(set->head);
+  free(set);
+}
+
+#define SET_NAME                        "skip list"
+#define SET_PROG                        "sl"
+#define SET_T                           sl_t
+#define SET_OP(op)                      sl_##op
+#include "set_bench.h"
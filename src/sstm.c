@@ -1,9 +1,39 @@
+#include <immintrin.h>
+#include <sched.h>
+#include <string.h>
+
 #include "sstm.h"
 
 LOCK_LOCAL_DATA;
-__thread sstm_metadata_t sstm_meta;	 /* per-thread metadata */
+__thread sstm_metadata_t sstm_meta SSTM_TLS_MODEL;	 /* per-thread metadata */
 sstm_metadata_global_t sstm_meta_global; /* global metadata */
 
+#define LOCK_TABLE_BYTES(size) (sstm_meta_global.n_nodes * (size) * sizeof(size_t))
+
+/* a single array so that stripes are plain indexes, with each slice
+   bound to its node. Zeroed by mmap: every stripe starts unlocked at version 0
+*/
+sstm_lock_table_t* sstm_lock_table_new(size_t size, size_t shift) {
+  sstm_lock_table_t* table = calloc(1, sizeof(sstm_lock_table_t));
+  size_t n;
+
+  table->size = size;
+  table->shift = shift;
+  table->locks = sstm_numa_alloc_on_node(LOCK_TABLE_BYTES(size), 0);
+  table->readers = calloc(sstm_meta_global.n_nodes * size, sizeof(uint32_t));
+  for (n = 0; n < sstm_meta_global.n_nodes; n++) {
+    sstm_numa_bind((void*) (table->locks + n * size), size * sizeof(size_t), n);
+  }
+  return table;
+}
+
+void sstm_lock_table_free(sstm_lock_table_t* table) {
+  sstm_numa_free((void*) table->locks, LOCK_TABLE_BYTES(table->size));
+  free((void*) table->writers);
+  free((void*) table->readers);
+  free(table);
+}
+
 /* initializes the TM runtime 
    (e.g., allocates the locks that the system uses ) 
 */
@@ -11,10 +41,25 @@ void sstm_start() {
 
   PRINTD("START GLOBAL 0\n");
 
-  sstm_meta_global.clock = 0;
-  int i;
-  for(i = 0; i < HASH_MODULO; i++) { // TODO useful ?
-    sstm_meta_global.locks[i] = 0;
+  sstm_meta_global.n_nodes = sstm_numa_nodes();
+
+  sstm_meta_global.lock_table = sstm_lock_table_new(HASH_MODULO, SSTM_STRIPE_SHIFT);
+  size_t n;
+  for (n = 0; n < sstm_meta_global.n_nodes; n++) {
+    sstm_meta_global.clocks[n].clock = 0;
+  }
+
+  select_validate_kernel();
+
+  // binary events, for trace_report
+  char* trace = getenv("SSTM_TRACE");
+  if (trace != NULL) {
+    sstm_trace_enable(trace);
+  }
+
+  // the durable regions get the state of the last run
+  if (sstm_meta_global.durable.enabled) {
+    sstm_durable_start();
   }
 
   PRINTD("START GLOBAL 1\n");
@@ -24,6 +69,107 @@ void sstm_start() {
    (e.g., deallocates the locks that the system uses ) 
 */
 void sstm_stop() {
+  if (sstm_meta_global.durable.enabled) {
+    sstm_durable_stop();
+  }
+  sstm_mv_stop();
+  sstm_trace_stop();
+  free(sstm_meta_global.spin_stats);
+  if (sstm_meta_global.resize.enabled) {
+    sstm_resize_stop();
+  }
+  while (sstm_meta_global.resize.retired != NULL) {
+    sstm_lock_table_t* table = sstm_meta_global.resize.retired;
+    sstm_meta_global.resize.retired = table->next;
+    sstm_lock_table_free(table);
+  }
+  sstm_lock_table_free(sstm_meta_global.lock_table);
+}
+
+void sstm_spin_enable(size_t budget) {
+  sstm_meta_global.spin_budget = budget;
+  INIT_LOCK(&sstm_meta_global.spin_lock);
+}
+
+/* the per-stripe counts are for one lock table: a thread that moves to
+   another one starts them over (its totals go on)
+*/
+static void spin_stats_follow(sstm_tx_t tx) {
+  free(tx->spin_stats);
+  tx->spin_size = sstm_meta_global.n_nodes * tx->lock_table->size;
+  tx->spin_stats = calloc(tx->spin_size, sizeof(sstm_spin_stat_t));
+  tx->spin_epoch = tx->lock_table->epoch;
+}
+
+/* adds the counts of a stopping thread to the global ones; per stripe,
+   only those of the newest table survive
+*/
+static void spin_stats_flush(sstm_tx_t tx) {
+  size_t i;
+
+  LOCK(&sstm_meta_global.spin_lock);
+  sstm_meta_global.spin_total.waits += tx->spin_total.waits;
+  sstm_meta_global.spin_total.released += tx->spin_total.released;
+  sstm_meta_global.spin_total.pauses += tx->spin_total.pauses;
+  if (sstm_meta_global.spin_stats == NULL || tx->spin_epoch > sstm_meta_global.spin_epoch) {
+    free(sstm_meta_global.spin_stats);
+    sstm_meta_global.spin_stats = calloc(tx->spin_size, sizeof(sstm_spin_stat_t));
+    sstm_meta_global.spin_size = tx->spin_size;
+    sstm_meta_global.spin_epoch = tx->spin_epoch;
+  }
+  if (tx->spin_epoch == sstm_meta_global.spin_epoch) {
+    for (i = 0; i < tx->spin_size; i++) {
+      sstm_spin_stat_t* s = &tx->spin_stats[i];
+      sstm_meta_global.spin_stats[i].waits += s->waits;
+      sstm_meta_global.spin_stats[i].released += s->released;
+      sstm_meta_global.spin_stats[i].pauses += s->pauses;
+    }
+  }
+  UNLOCK(&sstm_meta_global.spin_lock);
+
+  free(tx->spin_stats);
+  tx->spin_stats = NULL;
+}
+
+/* the total, then the stripes of the last table we waited the most on */
+void sstm_print_spin_stats() {
+  sstm_spin_stat_t* stats = sstm_meta_global.spin_stats;
+  sstm_spin_stat_t total = sstm_meta_global.spin_total;
+  size_t n = sstm_meta_global.spin_size;
+  size_t i, j, top[5] = { 0 };
+
+  if (stats == NULL) {
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < 5; j++) {
+      if (stats[i].waits > stats[top[j]].waits) {
+        memmove(top + j + 1, top + j, (4 - j) * sizeof(size_t));
+        top[j] = i;
+        break;
+      }
+    }
+  }
+
+  printf("# Spins  : %-10zu waits, %zu released (%.1f%%), %.1f pauses/wait (budget %zu)\n",
+         total.waits, total.released,
+         total.waits ? 100.0 * total.released / total.waits : 0.0,
+         total.waits ? (double) total.pauses / total.waits : 0.0,
+         sstm_meta_global.spin_budget);
+  for (j = 0; j < 5 && stats[top[j]].waits > 0; j++) {
+    sstm_spin_stat_t* s = &stats[top[j]];
+    printf("#   stripe %-6zu: %-10zu waits, %zu released, %.1f pauses/wait\n",
+           top[j], s->waits, s->released, (double) s->pauses / s->waits);
+  }
+}
+
+/* switches stores to write-through: in place under the stripe lock, with
+   an undo log replayed on abort. Call before the threads start
+*/
+void sstm_write_through_enable() {
+  assert(!sstm_meta_global.mv_enabled);
+  sstm_meta_global.write_through = 1;
 }
 
 
@@ -34,7 +180,23 @@ void sstm_thread_start() {
 
   PRINTD("START THREAD 0\n");
 
-  init_array_list(&sstm_meta.read_set);
+  sstm_meta.id = IAF_U64(&sstm_meta_global.n_threads);
+  sstm_meta.node = sstm_numa_current_node();
+  assert(sstm_meta.id < SSTM_MAX_THREADS);
+  sstm_meta_global.threads[sstm_meta.id] = &sstm_meta;
+  sstm_trace_thread_start(&sstm_meta);
+  IAF_U64(&sstm_meta_global.n_active);
+  // registered first: a resizer does not free the table we take (see sstm_resize.c)
+  __sync_synchronize();
+  sstm_meta.lock_table = sstm_meta_global.lock_table;
+  init_read_set(&sstm_meta.read_set);
+  init_array_list(&sstm_meta.lock_set);
+  init_array_list(&sstm_meta.undo_log);
+  init_array_list(&sstm_meta.add_log);
+  init_array_list(&sstm_meta.adapt.value_log);
+  if (sstm_meta_global.spin_budget > 0) {
+    spin_stats_follow(&sstm_meta);
+  }
   // TODO check if need to put writer set to NULL
 }
 
@@ -46,31 +208,135 @@ void sstm_thread_start() {
 void
 sstm_thread_stop()
 {
-  free_array_list(&sstm_meta.read_set);
+  sstm_meta_global.threads[sstm_meta.id] = NULL;
+  __sync_fetch_and_sub(&sstm_meta_global.n_active, 1);
+  free_read_set(&sstm_meta.read_set);
+  free_array_list(&sstm_meta.lock_set);
+  free(sstm_meta.owned.slots);
+  sstm_meta.owned.slots = NULL;
+  sstm_meta.owned.capacity = 0;
+  free_array_list(&sstm_meta.undo_log);
+  free_array_list(&sstm_meta.add_log);
+  free_array_list(&sstm_meta.adapt.value_log);
+  if (sstm_meta.spin_stats != NULL) {
+    spin_stats_flush(&sstm_meta);
+  }
+  sstm_mv_thread_stop(&sstm_meta);
+  sstm_visible_thread_stop(&sstm_meta);
+  sstm_retry_thread_stop(&sstm_meta);
+  sstm_durable_thread_stop(&sstm_meta);
+  sstm_trace_thread_stop(&sstm_meta);
 
   __sync_fetch_and_add(&sstm_meta_global.n_commits, sstm_meta.n_commits);
   __sync_fetch_and_add(&sstm_meta_global.n_aborts, sstm_meta.n_aborts);
 }
 
 
+/* aborts tx; if its aborts are deferred, returns ret from the calling
+   function instead (see sstm_tx_abort) */
+#define ABORT_RETURN(tx, reason, ret...)	\
+  {						\
+    sstm_tx_abort(tx, reason);			\
+    return ret;					\
+  }
+
+/* the clock view of a node is refreshed when we observe a version that
+ * is more recent than it. Until then, nothing committed on that node can
+ * be newer than our reads, so the read set only needs to be validated
+ * when the view moves (and only the clock of that node is touched).
+*/
+static inline void extend_snapshot(sstm_tx_t tx, size_t lock) {
+  size_t node = VERSION_NODE(lock);
+
+  if (VERSION_TS(lock) > tx->clock_view[node]) {
+    PRINTD("LOAD must extend snapshot of node %zu\n", node);
+    tx->clock_view[node] = sstm_meta_global.clocks[node].clock;
+    if (!validate(tx)) {
+      PRINTD("LOAD abort snapshot\n");
+      sstm_tx_abort(tx, 11);
+    }
+  }
+}
+
+/* the owner of a locked stripe is usually about to release it: waits
+ * for at most spin_budget pauses. Returns the last lock word read, still
+ * locked if the budget ran out.
+*/
+static size_t wait_stripe(sstm_tx_t tx, size_t stripe, size_t lock) {
+  volatile size_t* lock_addr = &tx->lock_table->locks[stripe];
+  size_t pauses = 0;
+
+  while (LOCK_IS_LOCKED(lock) && pauses < sstm_meta_global.spin_budget) {
+    PAUSE_IN();
+    pauses++;
+    lock = *lock_addr;
+  }
+
+  if (tx->spin_epoch != tx->lock_table->epoch) { // resized since
+    spin_stats_follow(tx);
+  }
+  sstm_spin_stat_t* s = &tx->spin_stats[stripe];
+  s->waits++;
+  s->released += !LOCK_IS_LOCKED(lock);
+  s->pauses += pauses;
+  tx->spin_total.waits++;
+  tx->spin_total.released += !LOCK_IS_LOCKED(lock);
+  tx->spin_total.pauses += pauses;
+  return lock;
+}
+
 /* transactionally reads the value of addr
  * On a more complex than GL-STM algorithm,
  * you need to do more work than simply reading the value.
+ * The unlocked, up-to-date case is inlined by sstm_tx_load() in sstm.h.
 */
-inline uintptr_t sstm_tx_load(volatile uintptr_t* addr) {
+uintptr_t sstm_tx_load_slow(sstm_tx_t tx, volatile uintptr_t* addr) {
 
-  size_t hash = hash_address(addr);
-  size_t before = sstm_meta_global.locks[hash];
+  if (tx->aborted) { // a deferred abort: the caller leaves the body (sstm.hpp)
+    return *addr;
+  }
+
+  if (tx->mode >= SSTM_MODE_GLOBAL_LOCK) {
+    return sstm_adapt_load(tx, addr);
+  }
+
+  if (tx->mode == SSTM_MODE_VISIBLE) {
+    return sstm_visible_load(tx, addr);
+  }
+
+  if (tx->mode != SSTM_MODE_OPTIMISTIC) {
+    // snapshot isolation sees its own writes, then the snapshot
+    if (tx->lock_set.size + tx->n_lazy > 0) {
+      nodee_t* curr = tx->write_set[hash_address(addr)];
+      for (; curr != NULL; curr = curr->next) {
+        if (curr->record.address == addr) {
+          return curr->record.value;
+        }
+      }
+    }
+    return sstm_mv_load(tx, addr);
+  }
+
+  size_t stripe = sstm_stripe_in(tx->lock_table, addr);
+  volatile size_t* lock = &tx->lock_table->locks[stripe];
+  size_t before = *lock;
   size_t value;
 
-  PRINTD("LOAD addr %i - lock %i\n", addr, before);
+  PRINTD("LOAD addr %p - lock %zu\n", addr, before);
+
+  if (LOCK_IS_LOCKED(before) && LOCK_OWNER(before) != tx->id && tx->spin_stats != NULL) {
+    before = wait_stripe(tx, stripe, before);
+  }
 
   // lock is owned by someone
-  if (before & 1) {
+  if (LOCK_IS_LOCKED(before)) {
     // it is mine
-    if (before >> 1 == sstm_meta.id) {
+    if (LOCK_OWNER(before) == tx->id) {
+      if (sstm_meta_global.write_through) { // memory holds our writes
+        return *addr;
+      }
       // check if we have written in it
-      nodee_t* curr = sstm_meta.write_set[hash];
+      nodee_t* curr = tx->write_set[hash_address(addr)];
       while (curr != NULL && curr->record.address != addr) {
         curr = curr->next;
       }
@@ -82,67 +348,145 @@ inline uintptr_t sstm_tx_load(volatile uintptr_t* addr) {
         value = curr->record.value;
       }
     } else { // hold by someone else
-      TX_ABORT(10);
+      if (tx->lock_table->writers != NULL) {
+        sstm_resize_conflict(tx, stripe, addr);
+      }
+      SSTM_TRACE(tx, SSTM_TRACE_LOAD_CONFLICT, 0, LOCK_OWNER(before), stripe);
+      ABORT_RETURN(tx, 10, *addr);
     }
   } else {
     PRINTD("LOAD nobody owns\n");
     value = *addr;
-    size_t after = sstm_meta_global.locks[hash];
+    size_t after = *lock;
 
     if (after != before) { // inconsistent read
       PRINTD("LOAD abort inconsistent\n");
-      TX_ABORT(10);
+      SSTM_TRACE(tx, SSTM_TRACE_LOAD_CONFLICT, 0, LOCK_IS_LOCKED(after) ? LOCK_OWNER(after) : 0, stripe);
+      ABORT_RETURN(tx, 10, value);
+    }
+    if (tx->lock_table->state == SSTM_TABLE_REPLACED) { // writers use another table
+      ABORT_RETURN(tx, 16, value);
     }
 
-    // // check if we must extend the snapshot
-    // if (sstm_meta.read_snapshot_timestamp < after) {
-    //   PRINTD("LOAD must create snapshot\n");
-    //   int i;
-    //   for (i = 0; i < sstm_meta.read_set.size; i++) {
-    //     record_t* record = &sstm_meta.read_set.array[i];
-    //     if (record->version != sstm_meta_global.locks[hash_address(record->address)]) {
-    //       PRINTD("LOAD abort snapshot\n");
-    //       TX_ABORT(10);
-    //     }
-    //   }
-    //   // update time stamp of snapshot
-    //   sstm_meta.read_snapshot_timestamp = after;
-    // }
+    extend_snapshot(tx, after);
 
-    append_array_list(&sstm_meta.read_set, addr, after, 0); // we don't care about the read value
+    append_read_set(&tx->read_set, stripe, after);
   }
 
 
   return value;
 }
 
-/* transactionally writes val in addr
- * On a more complex than GL-STM algorithm,
- * you need to do more work than simply reading the value.
+/* a visible reader keeps a stripe we need: it gets our locks and the
+   cpu, rather than a retry that takes them again
 */
-inline void sstm_tx_store(volatile uintptr_t* addr, uintptr_t val) {
+static void yield_to_readers(sstm_tx_t tx) {
+  release_locks(tx, 0);
+  tx->lock_set.size = 0;
+  sched_yield();
+  sstm_tx_abort(tx, 3);
+}
 
-  size_t hash = hash_address(addr);
-  size_t lock = sstm_meta_global.locks[hash];
+/* acquires the lock of the stripe of addr, unless we already hold it.
+   Returns 1 if the lock was already ours.
+*/
+static inline size_t acquire_stripe(sstm_tx_t tx, volatile uintptr_t* addr) {
+
+  sstm_lock_table_t* table = tx->lock_table;
+  size_t stripe = sstm_stripe_in(table, addr);
+  volatile size_t* lock_addr = &table->locks[stripe];
+  size_t lock = *lock_addr;
 
-  PRINTD("STORE addr %i - val %i - lock %i\n", addr, val, lock);
+  PRINTD("STORE addr %p - lock %zu\n", addr, lock);
 
-  size_t alreadyIn = 0;
+  if (LOCK_IS_LOCKED(lock) && LOCK_OWNER(lock) != tx->id && tx->spin_stats != NULL) {
+    lock = wait_stripe(tx, stripe, lock);
+  }
 
   // owned by someone
-  if (lock & 1) {
+  if (LOCK_IS_LOCKED(lock)) {
     // myself
-    if (lock >> 1 == sstm_meta.id) {
-      alreadyIn = 1;
+    if (LOCK_OWNER(lock) == tx->id) {
+      PRINTD("STORE already in lock\n");
+      return 1;
     } else { // someone else
-      TX_ABORT(1);
+      if (table->writers != NULL) {
+        sstm_resize_conflict(tx, stripe, addr);
+      }
+      SSTM_TRACE(tx, SSTM_TRACE_STORE_CONFLICT, 0, LOCK_OWNER(lock), stripe);
+      ABORT_RETURN(tx, 1, 1);
     }
-  } 
+  }
+
+  if (sstm_meta_global.n_visible > 0 && !sstm_visible_defer(table, stripe)) {
+    yield_to_readers(tx);
+    return 1;
+  }
+
+  size_t prev;
+  while (1) {
+    PRINTD("STORE try new lock value %zu\n", LOCK_OWNED_BY(tx->id));
 
-  if(alreadyIn) {
-    PRINTD("STORE already in lock\n");
+    prev = CAS_U64(lock_addr, lock, LOCK_OWNED_BY(tx->id));
+    PRINTD("STORE lock %zu - return %zu\n", *lock_addr, prev);
+    if (lock == prev) { // success
+      PRINTD("STORE lock acquired\n");
+      break;
+    }
+    if (LOCK_IS_LOCKED(prev)) {
+      PRINTD("STORE abort\n");
+      if (table->writers != NULL) {
+        sstm_resize_conflict(tx, stripe, addr);
+      }
+      SSTM_TRACE(tx, SSTM_TRACE_STORE_CONFLICT, 0, LOCK_OWNER(prev), stripe);
+      ABORT_RETURN(tx, 2, 1);
+    }
+    lock = prev;
+  }
+  if (table->writers != NULL) {
+    table->writers[stripe] = (uintptr_t) addr;
+  }
+  SSTM_TRACE(tx, SSTM_TRACE_STORE_LOCK, 0, 0, stripe);
+
+  // remember the version to restore it on abort
+  append_array_list(&tx->lock_set, (volatile uintptr_t*) lock_addr, 0, lock);
+
+  // the resizer closed the table before it could see our lock: the
+  // write waits for the next table (the CAS was a full barrier)
+  if (table->state != SSTM_TABLE_OPEN) {
+    tx->resize.blocked = 1;
+    ABORT_RETURN(tx, 15, 1);
+  }
+
+  // a visible reader registered while we were locking: it wins
+  if (sstm_meta_global.n_visible > 0 && !sstm_visible_defer(table, stripe)) {
+    yield_to_readers(tx);
+    return 1;
+  }
+
+  // later loads of this stripe read memory directly
+  extend_snapshot(tx, lock);
+  return 0;
+}
+
+/* buffers the write of val in addr, whose stripe we hold.
+   Only searches the write set if we may have written addr before.
+*/
+static inline void buffer_write(sstm_tx_t tx, volatile uintptr_t* addr, uintptr_t val, size_t alreadyIn) {
+
+  if (sstm_meta_global.write_through) {
+    if (!tx->aborted) { // a deferred abort may have left the stripe unlocked
+      append_array_list(&tx->undo_log, addr, *addr, 0);
+      *addr = val;
+    }
+    return;
+  }
+
+  size_t hash = hash_address(addr);
+
+  if (alreadyIn) {
     // check if we have written in it
-    nodee_t* curr = sstm_meta.write_set[hash];
+    nodee_t* curr = tx->write_set[hash];
     while (curr != NULL && curr->record.address != addr) {
       curr = curr->next;
     }
@@ -150,26 +494,6 @@ inline void sstm_tx_store(volatile uintptr_t* addr, uintptr_t val) {
       PRINTD("STORE already written in value\n");
       curr->record.value = val;
       return;
-    } 
-  } else { // need to acquire the lock
-    size_t prev;
-    while (1) {
-      PRINTD("STORE try new lock value %i\n", (sstm_meta.id << 1) | 1);
-      // TODO problem here
-
-      // prev = CAS_U64(&sstm_meta.write_set[hash], 1000, 2000);
-      // PRINTD("STORE lock %i - return %i\n", sstm_meta.write_set[hash], prev);
-
-      prev = CAS_U64(&sstm_meta_global.locks[hash], lock, (sstm_meta.id << 1) | 1);
-      PRINTD("STORE lock %i - return %i\n", sstm_meta_global.locks[hash], prev);
-      if (lock == prev) { // success
-        PRINTD("STORE lock acquired\n");
-        break;
-      }
-      if (prev & 1) {
-        PRINTD("STORE abort\n");
-        TX_ABORT(2);
-      }
     }
   }
 
@@ -178,74 +502,609 @@ inline void sstm_tx_store(volatile uintptr_t* addr, uintptr_t val) {
   newHead->record.value = val;
   newHead->record.address = addr;
   newHead->record.version = 0; // we don't care about version
-  newHead->next = sstm_meta.write_set[hash];
-  sstm_meta.write_set[hash] = newHead;
+  newHead->next = tx->write_set[hash];
+  tx->write_set[hash] = newHead;
+}
+
+/* buffers a write without touching the stripe lock (NOrec backend) */
+void sstm_buffer_write(sstm_tx_t tx, volatile uintptr_t* addr, uintptr_t val) {
+  buffer_write(tx, addr, val, 1);
+}
+
+/* transactionally writes val in addr
+ * On a more complex than GL-STM algorithm,
+ * you need to do more work than simply reading the value.
+*/
+void sstm_tx_store_d(sstm_tx_t tx, volatile uintptr_t* addr, uintptr_t val) {
+  PRINTD("STORE addr %p - val %zu\n", addr, val);
+  assert(tx->mode != SSTM_MODE_SNAPSHOT && tx->mode != SSTM_MODE_VISIBLE);
+  if (tx->aborted) {
+    return;
+  }
+  if (tx->mode >= SSTM_MODE_GLOBAL_LOCK) {
+    sstm_adapt_store(tx, addr, val);
+    return;
+  }
+  buffer_write(tx, addr, val, acquire_stripe(tx, addr));
+}
+
+/* copies len bytes with 32 and 16-byte vector moves; the source may be
+   concurrently written, the stripe versions tell if the copy is usable
+*/
+static inline void copy_words(void* dst, volatile void* src, size_t len) {
+  uint8_t* d = dst;
+  const uint8_t* s = (const uint8_t*) src;
+
+#ifdef __AVX2__
+  for (; len >= 32; len -= 32, s += 32, d += 32) {
+    _mm256_storeu_si256((__m256i*) d, _mm256_loadu_si256((const __m256i*) s));
+  }
+#endif
+  for (; len >= 16; len -= 16, s += 16, d += 16) {
+    _mm_storeu_si128((__m128i*) d, _mm_loadu_si128((const __m128i*) s));
+  }
+  for (; len >= sizeof(uintptr_t); len -= sizeof(uintptr_t), s += sizeof(uintptr_t), d += sizeof(uintptr_t)) {
+    *(uintptr_t*) d = *(const volatile uintptr_t*) s;
+  }
+}
+
+/* transactionally reads len bytes from src into dst.
+ * Each covered stripe gets one read-set entry: the versions of all the
+ * stripes are read, the payload is copied at once, then the versions
+ * are checked again.
+*/
+void sstm_tx_load_range_d(sstm_tx_t tx, void* dst, volatile void* src, size_t len) {
+
+  assert((uintptr_t) src % sizeof(uintptr_t) == 0 && len % sizeof(uintptr_t) == 0);
+
+  uintptr_t start = (uintptr_t) src, end = start + len, s;
+  size_t first = tx->read_set.size, i;
+
+  PRINTD("LOAD RANGE addr %p - len %zu\n", src, len);
+
+  if (tx->aborted) {
+    copy_words(dst, src, len);
+    return;
+  }
+
+  if (tx->mode == SSTM_MODE_VISIBLE) {
+    for (s = start; s < end; s = sstm_stripe_next(tx->lock_table, s)) {
+      if (!sstm_visible_register(tx, (volatile uintptr_t*) s)) {
+        break;
+      }
+    }
+    copy_words(dst, src, len);
+    return;
+  }
+
+  if (tx->mode != SSTM_MODE_OPTIMISTIC) {
+    for (i = 0; i < len / sizeof(uintptr_t); i++) {
+      ((uintptr_t*) dst)[i] = sstm_tx_load_slow(tx, (volatile uintptr_t*) src + i);
+    }
+    return;
+  }
+
+  for (s = start; s < end; s = sstm_stripe_next(tx->lock_table, s)) {
+    size_t stripe = sstm_stripe_in(tx->lock_table, (volatile uintptr_t*) s);
+    size_t lock = tx->lock_table->locks[stripe];
+    if (LOCK_IS_LOCKED(lock)) {
+      if (LOCK_OWNER(lock) != tx->id) {
+        sstm_tx_abort(tx, 12);
+        copy_words(dst, src, len);
+        return;
+      }
+      // our own buffered writes must show: fall back to word loads
+      tx->read_set.size = first;
+      for (i = 0; i < len / sizeof(uintptr_t); i++) {
+        ((uintptr_t*) dst)[i] = sstm_tx_load_d(tx, (volatile uintptr_t*) src + i);
+      }
+      return;
+    }
+    append_read_set(&tx->read_set, stripe, lock);
+  }
+
+  copy_words(dst, src, len);
+
+  read_set_t* rs = &tx->read_set;
+  for (i = first; i < rs->size; i++) {
+    if (tx->lock_table->locks[rs->stripes[i]] != rs->versions[i]) {
+      PRINTD("LOAD RANGE abort inconsistent\n");
+      ABORT_RETURN(tx, 12);
+    }
+  }
+  if (tx->lock_table->state == SSTM_TABLE_REPLACED) {
+    ABORT_RETURN(tx, 16);
+  }
+  for (i = first; i < rs->size; i++) {
+    extend_snapshot(tx, rs->versions[i]);
+  }
+}
+
+/* transactionally writes len bytes from src to dst, taking the lock of
+   each covered stripe once
+*/
+void sstm_tx_store_range_d(sstm_tx_t tx, volatile void* dst, const void* src, size_t len) {
+
+  assert((uintptr_t) dst % sizeof(uintptr_t) == 0 && len % sizeof(uintptr_t) == 0);
+
+  volatile uintptr_t* d = dst;
+  const uintptr_t* v = src;
+  volatile uintptr_t* end = d + len / sizeof(uintptr_t);
 
-  PRINTD("AFTER STORE lock %i\n", sstm_meta_global.locks[hash]);
+  PRINTD("STORE RANGE addr %p - len %zu\n", dst, len);
+  assert(tx->mode != SSTM_MODE_SNAPSHOT && tx->mode != SSTM_MODE_VISIBLE);
+
+  if (tx->mode >= SSTM_MODE_GLOBAL_LOCK) {
+    for (; d < end; d++, v++) {
+      sstm_tx_store_d(tx, d, *v);
+    }
+    return;
+  }
+
+  while (d < end) {
+    size_t alreadyIn = acquire_stripe(tx, d);
+    volatile uintptr_t* stripe_end = (volatile uintptr_t*) sstm_stripe_next(tx->lock_table, (uintptr_t) d);
+    for (; d < end && d < stripe_end; d++, v++) {
+      buffer_write(tx, d, *v, alreadyIn);
+    }
+  }
 }
 
-/* cleaning up in case of an abort 
+/* buffers the write without locking the stripe: it is locked at commit
+*/
+void sstm_tx_store_lazy_d(sstm_tx_t tx, volatile uintptr_t* addr, uintptr_t val) {
+  PRINTD("STORE LAZY addr %p - val %zu\n", addr, val);
+  assert(tx->mode != SSTM_MODE_SNAPSHOT && tx->mode != SSTM_MODE_VISIBLE);
+  if (tx->aborted) {
+    return;
+  }
+  if (sstm_meta_global.write_through || tx->mode >= SSTM_MODE_GLOBAL_LOCK) {
+    sstm_tx_store_d(tx, addr, val); // in place needs the lock now
+    return;
+  }
+  buffer_write(tx, addr, val, 1);
+  tx->n_lazy++;
+}
+
+/* logs delta to be added to addr at commit. The word is not read, so
+   transactions that only add to it do not conflict until commit, where
+   its stripe is locked just for the write-back
+*/
+void sstm_tx_add_d(sstm_tx_t tx, volatile uintptr_t* addr, intptr_t delta) {
+  PRINTD("ADD addr %p - delta %zd\n", addr, delta);
+  assert(tx->mode != SSTM_MODE_SNAPSHOT && tx->mode != SSTM_MODE_VISIBLE);
+  if (tx->aborted) {
+    return;
+  }
+  if (tx->mode >= SSTM_MODE_GLOBAL_LOCK) { // nothing to commute with
+    sstm_tx_store_d(tx, addr, sstm_tx_load_slow(tx, addr) + delta);
+    return;
+  }
+  append_array_list(&tx->add_log, addr, (uintptr_t) delta, 0);
+}
+
+/* aborts tx: jumps back to its start, or, if its aborts are deferred,
+   releases its locks and flags it so that the caller unwinds normally
+   and retries (the operations of an aborted transaction are no-ops)
+*/
+void sstm_tx_abort(sstm_tx_t tx, int reason) {
+  if (!tx->defer_aborts) {
+    TX_ABORT_D(tx, reason);
+  }
+  if (!tx->aborted) {
+    PRINTD("|| deferred abort (%d)\n", reason);
+    SSTM_TRACE(tx, SSTM_TRACE_ABORT, reason, 0, 0);
+    tx->aborted = reason;
+    release_locks(tx, 0);
+    tx->lock_set.size = 0;
+  }
+}
+
+/* cleaning up in case of an abort
    (e.g., flush the read or write logs)
 */
-void sstm_tx_cleanup() {
+void sstm_tx_cleanup_d(sstm_tx_t tx) {
+  release_locks(tx, 0); // may restore words of the memory freed next
   sstm_alloc_on_abort();
-  clear_transaction();
-  sstm_meta.n_aborts++;
+  if (tx->mode == SSTM_MODE_SNAPSHOT || tx->mode == SSTM_MODE_SI) {
+    sstm_mv_end(tx);
+  } else if (tx->mode == SSTM_MODE_VISIBLE) {
+    sstm_visible_end(tx);
+  }
+  if (sstm_meta_global.adapt.enabled) {
+    sstm_adapt_abort_end(tx);
+  }
+  clear_transaction(tx);
+  tx->aborted = 0;
+  if (tx->retry.pending) {
+    tx->retry.pending = 0;
+    tx->retry.n_retries++;
+    sstm_retry_park(tx);
+  } else {
+    tx->n_aborts++;
+  }
 }
 
-/* tries to commit a transaction
-   (e.g., validates some version number, and/or
-   acquires a couple of locks)
- */
-void sstm_tx_commit() {
+static void commit(sstm_tx_t tx) {
 
   PRINTD("COMMIT 0\n");
 
-  size_t timestamp = IAF_U64(&sstm_meta_global.clock);
+  if (tx->aborted) {
+    return;
+  }
 
-  sstm_alloc_on_commit(); // free the memory
+  // the global lock and NOrec backends
+  if (tx->mode >= SSTM_MODE_GLOBAL_LOCK) {
+    size_t read_only = tx->n_lazy == 0;
+    sstm_adapt_commit(tx);
+    if (tx->aborted) {
+      return;
+    }
+    sstm_alloc_on_commit();
+    clear_transaction(tx);
+    tx->n_commits++;
+    sstm_adapt_commit_end(tx, read_only);
+    return;
+  }
 
+  // snapshot reads are consistent by construction
+  if (tx->mode == SSTM_MODE_SNAPSHOT) {
+    sstm_mv_end(tx);
+    clear_transaction(tx);
+    tx->n_commits++;
+    return;
+  }
+
+  // and visible reads could not be overwritten
+  if (tx->mode == SSTM_MODE_VISIBLE) {
+    sstm_visible_end(tx);
+    clear_transaction(tx);
+    tx->n_commits++;
+    if (sstm_meta_global.adapt.enabled) {
+      sstm_adapt_commit_end(tx, 1);
+    }
+    return;
+  }
+
+  // lazily written stripes are locked only now
+  if (tx->n_lazy > 0) {
+    int i;
+    for (i = 0; i < HASH_MODULO; i++) {
+      nodee_t* curr;
+      for (curr = tx->write_set[i]; curr != NULL; curr = curr->next) {
+        acquire_stripe(tx, curr->record.address);
+        if (tx->aborted) {
+          return;
+        }
+      }
+    }
+  }
+
+  // and so are the stripes of the deltas
+  size_t j;
+  for (j = 0; j < tx->add_log.size; j++) {
+    acquire_stripe(tx, tx->add_log.array[j].address);
+    if (tx->aborted) {
+      return;
+    }
+  }
+
+  // read-only: the reads were kept consistent while loading
+  if (tx->lock_set.size == 0) {
+    if (tx->mode == SSTM_MODE_SI) {
+      sstm_mv_end(tx);
+    }
+    sstm_alloc_on_commit();
+    clear_transaction(tx);
+    tx->n_commits++;
+    if (sstm_meta_global.adapt.enabled) {
+      sstm_adapt_commit_end(tx, 1);
+    }
+    return;
+  }
+
+  // before or after a snapshot being taken: decided before validating,
+  // so that a transaction we read over, which validated earlier, does
+  // not land after the snapshot while we land before it
+  if (sstm_meta_global.snapshot.n_regions > 0) {
+    sstm_snapshot_commit(tx);
+  }
+
+  // every written stripe is already locked: take a timestamp on our
+  // node's clock and check that nothing we read has changed. Snapshot
+  // readers wait for our write-back while we are taking it
+  if (sstm_meta_global.mv_enabled) {
+    tx->commit_ts = SSTM_MV_PENDING;
+    __sync_synchronize();
+  }
+  size_t timestamp = IAF_U64(&sstm_meta_global.clocks[tx->node].clock);
+  size_t version = LOCK_VERSION(timestamp, tx->node);
+  // read with our stripes locked: a retrier that parks later sees them (sstm_retry.c)
+  size_t wake = sstm_meta_global.n_parked > 0;
+  tx->commit_ts = sstm_meta_global.mv_enabled ? version : 0;
+
+  // under snapshot isolation only write-write conflicts matter: nobody
+  // may have committed to our stripes since the snapshot
+  if (tx->mode == SSTM_MODE_SI ? !sstm_mv_validate_writes(tx) : !validate(tx)) {
+    if (sstm_meta_global.snapshot.n_regions > 0) { // a snapshot may wait for our epoch
+      sstm_snapshot_commit_end(tx);
+    }
+    ABORT_RETURN(tx, 20);
+  }
+
+  // our place in the redo log, before any reader can see the writes
+  if (sstm_meta_global.durable.enabled) {
+    sstm_durable_reserve(tx);
+  }
 
   PRINTD("COMMIT 1\n");
 
-  // write all the values
+  // write all the values (already in place when writing through)
   int i;
-  for (i=0; i < HASH_MODULO; i++) {
-    nodee_t* curr = sstm_meta.write_set[i];
+  for (i = 0; i < HASH_MODULO && !sstm_meta_global.write_through; i++) {
+    nodee_t* curr = tx->write_set[i];
 
     while (curr != NULL) {
-      PRINTD("COMMIT 4 -- %i\n", curr);
-      PRINTD("COMMIT 4 -- %i\n", curr->record.address);
+      PRINTD("COMMIT 4 -- %p\n", curr);
+      PRINTD("COMMIT 4 -- %p\n", curr->record.address);
+      if (sstm_meta_global.mv_enabled) { // keep the value we overwrite
+        sstm_mv_push(tx, sstm_stripe_of(curr->record.address), curr->record.address, version);
+      }
       *curr->record.address = curr->record.value;
       curr = curr->next;
       PRINTD("COMMIT 5\n");
     }
+  }
 
-    // change the version
-    if (sstm_meta.write_set[i] != NULL) {
-      CAS_U64(&sstm_meta_global.locks[i], sstm_meta_global.locks[i], timestamp << 1);
+  // then add the deltas, on top of our own stores
+  for (j = 0; j < tx->add_log.size; j++) {
+    record_t* add = &tx->add_log.array[j];
+    if (sstm_meta_global.mv_enabled) {
+      sstm_mv_push(tx, sstm_stripe_of(add->address), add->address, version);
     }
+    *add->address += add->value;
+  }
+
+  if (sstm_meta_global.durable.enabled) {
+    sstm_durable_append(tx);
+  }
+  if (sstm_meta_global.snapshot.n_regions > 0) {
+    sstm_snapshot_commit_end(tx);
+  }
+
+  // change the version
+  release_locks(tx, version);
+  if (wake) {
+    sstm_retry_wake(tx);
   }
+  if (tx->mode == SSTM_MODE_SI) {
+    sstm_mv_end(tx);
+  }
+  if (sstm_meta_global.mv_enabled) {
+    sstm_mv_on_commit(tx);
+  }
+
+  sstm_alloc_on_commit(); // free the memory, after the write-back touched it
 
   PRINTD("COMMIT 7\n");
 
-  clear_transaction();
-  sstm_meta.n_commits++;		
+  clear_transaction(tx);
+  tx->n_commits++;
+  if (sstm_meta_global.adapt.enabled) {
+    sstm_adapt_commit_end(tx, 0);
+  }
+
+  // with our locks released: the group may grow meanwhile
+  if (sstm_meta_global.durable.enabled) {
+    sstm_durable_wait(tx);
+  }
+}
+
+/* tries to commit a transaction
+   (e.g., validates some version number, and/or
+   acquires a couple of locks)
+ */
+void sstm_tx_commit_d(sstm_tx_t tx) {
+  commit(tx);
+  if (!tx->aborted) {
+    SSTM_TRACE(tx, SSTM_TRACE_COMMIT, 0, 0, 0);
+  }
+}
+
+/* the entry of the lock set for lock_addr, NULL if we do not hold it.
+   The locks acquired since the last lookup are indexed first, so that a
+   validation costs O(reads + writes)
+*/
+static record_t* owned_lock(sstm_tx_t tx, volatile size_t* lock_addr) {
+  owned_map_t* m = &tx->owned;
+  array_list_t* ls = &tx->lock_set;
+  volatile size_t* locks = tx->lock_table->locks;
+  size_t i, mask;
+
+  if (2 * ls->size > m->capacity) { // index them all again
+    size_t capacity = m->capacity > 0 ? m->capacity : 64;
+    while (2 * ls->size > capacity) {
+      capacity *= 2;
+    }
+    free(m->slots);
+    m->slots = (uint32_t*) calloc(capacity, sizeof(uint32_t));
+    m->capacity = capacity;
+    m->size = 0;
+  }
+  mask = m->capacity - 1;
+  for (; m->size < ls->size; m->size++) {
+    i = ((volatile size_t*) ls->array[m->size].address - locks) & mask;
+    while (m->slots[i] != 0) {
+      i = (i + 1) & mask;
+    }
+    m->slots[i] = m->size + 1;
+  }
+
+  for (i = (lock_addr - locks) & mask; m->slots[i] != 0; i = (i + 1) & mask) {
+    record_t* owned = &ls->array[m->slots[i] - 1];
+    if (owned->address == (volatile uintptr_t*) lock_addr) {
+      return owned;
+    }
+  }
+  return NULL;
+}
+
+/* empties the index, newest first so that the probe sequences of the
+   entries left stay intact; the entries of the lock set are still there
+   after it is cleared
+*/
+static void clear_owned(sstm_tx_t tx) {
+  owned_map_t* m = &tx->owned;
+  volatile size_t* locks = tx->lock_table->locks;
+  size_t mask = m->capacity - 1;
+
+  while (m->size > 0) {
+    size_t i = ((volatile size_t*) tx->lock_set.array[m->size - 1].address - locks) & mask;
+    while (m->slots[i] != m->size) {
+      i = (i + 1) & mask;
+    }
+    m->slots[i] = 0;
+    m->size--;
+  }
 }
 
-void clear_transaction() {
+/* a stripe whose lock word differs from the one we read is still valid
+   if we hold it and it had that version when we acquired it
+*/
+static inline size_t validate_own(sstm_tx_t tx, size_t stripe, size_t version) {
+  volatile size_t* lock_addr = &tx->lock_table->locks[stripe];
+  size_t lock = *lock_addr;
+  record_t* owned;
+
+  if (!LOCK_IS_LOCKED(lock) || LOCK_OWNER(lock) != tx->id) {
+    return 0;
+  }
+  owned = owned_lock(tx, lock_addr);
+  return owned != NULL && owned->version == version;
+}
+
+static size_t validate_scalar(sstm_tx_t tx, const uint32_t* stripes, const size_t* versions, size_t n) {
+  size_t i;
+  for (i = 0; i < n; i++) {
+    if (tx->lock_table->locks[stripes[i]] != versions[i]
+        && !validate_own(tx, stripes[i], versions[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* gathers the lock words of 4 stripes at once and compares them with
+   the observed versions; mismatches are rechecked by the scalar code
+*/
+__attribute__((target("avx2")))
+static size_t validate_avx2(sstm_tx_t tx, const uint32_t* stripes, const size_t* versions, size_t n) {
+  const long long* table = (const long long*) tx->lock_table->locks;
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128i idx = _mm_loadu_si128((const __m128i*) (stripes + i));
+    __m256i locks = _mm256_i32gather_epi64(table, idx, 8);
+    __m256i seen = _mm256_loadu_si256((const __m256i*) (versions + i));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(locks, seen)) != -1
+        && !validate_scalar(tx, stripes + i, versions + i, 4)) {
+      return 0;
+    }
+  }
+  return validate_scalar(tx, stripes + i, versions + i, n - i);
+}
+
+static size_t (*validate_kernel)(sstm_tx_t, const uint32_t*, const size_t*, size_t) = validate_scalar;
+
+void select_validate_kernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    validate_kernel = validate_avx2;
+  } else {
+    validate_kernel = validate_scalar;
+  }
+}
+
+/* the version we observed must still be there, or we hold the lock
+   and it was there when we acquired it
+*/
+size_t validate(sstm_tx_t tx) {
+  read_set_t* rs = &tx->read_set;
+  size_t valid = validate_kernel(tx, rs->stripes, rs->versions, rs->size);
+  SSTM_TRACE(tx, SSTM_TRACE_VALIDATE, valid, 0, rs->size);
+  return valid;
+}
+
+/* releases every held lock with the given version, or with the version
+   it had before we acquired it if version is 0
+*/
+void release_locks(sstm_tx_t tx, size_t version) {
+  size_t i;
+
+  if (version == 0 && tx->undo_log.size > 0 && tx->mode != SSTM_MODE_GLOBAL_LOCK) {
+    // restore memory, newest first. The speculative values may have
+    // been read: a new version makes those readers fail validation
+    for (i = tx->undo_log.size; i-- > 0; ) {
+      *tx->undo_log.array[i].address = tx->undo_log.array[i].value;
+    }
+    tx->undo_log.size = 0;
+    version = LOCK_VERSION(IAF_U64(&sstm_meta_global.clocks[tx->node].clock), tx->node);
+  }
+
+  for (i = 0; i < tx->lock_set.size; i++) {
+    record_t* record = &tx->lock_set.array[i];
+    *record->address = version ? version : record->version;
+  }
+  tx->commit_ts = 0;
+}
+
+void clear_transaction(sstm_tx_t tx) {
   // reset the readers and writers lists
   int i;
+  if (tx->owned.size > 0) {
+    clear_owned(tx);
+  }
   for (i=0; i < HASH_MODULO; i++) {
-    nodee_t* curr = sstm_meta.write_set[i];
+    nodee_t* curr = tx->write_set[i];
     free_linked_list(curr);
-    sstm_meta.write_set[i] = NULL;
+    tx->write_set[i] = NULL;
   }
-  sstm_meta.read_set.size = 0;
+  tx->read_set.size = 0;
+  tx->lock_set.size = 0;
+  tx->undo_log.size = 0;
+  tx->add_log.size = 0;
+  tx->n_lazy = 0;
+  tx->mode = SSTM_MODE_OPTIMISTIC;
+  if (sstm_meta_global.resize.enabled) {
+    sstm_resize_end(tx);
+  }
+}
+
+/*
+ * THREAD-LOCAL API: the same operations on the descriptor of the calling thread
+ */
+
+void sstm_tx_store(volatile uintptr_t* addr, uintptr_t val) {
+  sstm_tx_store_d(&sstm_meta, addr, val);
+}
+
+void sstm_tx_load_range(void* dst, volatile void* src, size_t len) {
+  sstm_tx_load_range_d(&sstm_meta, dst, src, len);
+}
+
+void sstm_tx_store_range(volatile void* dst, const void* src, size_t len) {
+  sstm_tx_store_range_d(&sstm_meta, dst, src, len);
 }
 
-size_t hash_address(volatile uintptr_t* addr) {
-  return ((size_t) addr / 4) % HASH_MODULO;
+void sstm_tx_add(volatile uintptr_t* addr, intptr_t delta) {
+  sstm_tx_add_d(&sstm_meta, addr, delta);
+}
+
+void sstm_tx_cleanup() {
+  sstm_tx_cleanup_d(&sstm_meta);
+}
+
+void sstm_tx_commit() {
+  sstm_tx_commit_d(&sstm_meta);
 }
 
 /*
@@ -272,6 +1131,34 @@ void append_array_list(array_list_t* ls, volatile uintptr_t* address, uintptr_t
   ls->size++;
 }
 
+void init_read_set(read_set_t* rs) {
+  rs->size = 0;
+  rs->capacity = LIST_INITIAL_SIZE;
+  rs->stripes = malloc(LIST_INITIAL_SIZE * sizeof(uint32_t));
+  rs->versions = malloc(LIST_INITIAL_SIZE * sizeof(size_t));
+}
+
+void append_read_set(read_set_t* rs, size_t stripe, size_t version) {
+
+  // extend the capacity of the read set if needed
+  if (rs->size >= rs->capacity) {
+    rs->capacity *= LIST_EXPEND_FACTOR;
+    rs->stripes = realloc(rs->stripes, rs->capacity * sizeof(uint32_t));
+    rs->versions = realloc(rs->versions, rs->capacity * sizeof(size_t));
+  }
+
+  rs->stripes[rs->size] = stripe;
+  rs->versions[rs->size] = version;
+  rs->size++;
+}
+
+void free_read_set(read_set_t* rs) {
+  free(rs->stripes);
+  free(rs->versions);
+  rs->stripes = NULL;
+  rs->versions = NULL;
+}
+
 void free_array_list(array_list_t* ls) {
   free(ls->array);
   ls->array = NULL;
@@ -286,6 +1173,20 @@ void free_linked_list(nodee_t* ls) {
   }
 }
 
+void sstm_counters(size_t* commits, size_t* aborts) {
+  size_t i;
+
+  *commits = sstm_meta_global.n_commits;
+  *aborts = sstm_meta_global.n_aborts;
+  for (i = 0; i < SSTM_MAX_THREADS; i++) {
+    sstm_metadata_t* t = sstm_meta_global.threads[i];
+    if (t != NULL) {
+      *commits += t->n_commits;
+      *aborts += t->n_aborts;
+    }
+  }
+}
+
 
 /* prints the TM system stats
 ****** DO NOT TOUCH *********
@@ -0,0 +1,274 @@
+#include "sstm.h"
+
+/* Several backends in one runtime.
+ *
+ * All the transactions run on the same backend: the optimistic stripe
+ * STM of sstm.c, a global lock, or NOrec (a single sequence lock and
+ * value-based validation of the reads). Threads flush their commit and
+ * abort counts every SSTM_ADAPT_FLUSH commits; the thread that completes
+ * a window of SSTM_ADAPT_WINDOW commits decides which backend suits it
+ * and, if it changes, switches at a quiescent point: new transactions
+ * wait while the running ones finish.
+ */
+
+#define ADAPT (sstm_meta_global.adapt)
+
+enum { COMMITS, ABORTS, RO_COMMITS, N_COUNTS }; // of a window
+
+void sstm_adapt_enable(size_t backend) {
+  assert(!sstm_meta_global.mv_enabled && !sstm_meta_global.write_through);
+  assert(!sstm_meta_global.durable.enabled); // its backends write back without logging
+  assert(backend < SSTM_BACKENDS);
+  INIT_LOCK(&ADAPT.window.decide_lock);
+  GL_INIT_LOCK(&ADAPT.gl_lock);
+  ADAPT.backend = backend;
+  ADAPT.enabled = 1;
+}
+
+void sstm_adapt_print_stats() {
+  static const char* names[SSTM_BACKENDS] = { "optimistic", "global-lock", "norec" };
+  size_t b;
+
+  if (!ADAPT.enabled) {
+    return;
+  }
+  printf("# Backend: %-10zu switches, windows:", ADAPT.n_switches);
+  for (b = 0; b < SSTM_BACKENDS; b++) {
+    printf(" %s %zu", names[b], ADAPT.windows[b]);
+  }
+  printf(" (now %s)\n", names[ADAPT.backend]);
+}
+
+void sstm_adapt_begin(sstm_tx_t tx) {
+  sstm_adapt_thread_t* t = &tx->adapt;
+
+  while (1) {
+    t->in_tx = 1;
+    __sync_synchronize();
+    if (!ADAPT.switching) {
+      break;
+    }
+    t->in_tx = 0;
+    while (ADAPT.switching) {
+      PAUSE_IN();
+    }
+  }
+
+  switch (ADAPT.backend) {
+  case SSTM_BACKEND_GLOBAL_LOCK:
+    GL_LOCK(&ADAPT.gl_lock);
+    tx->mode = SSTM_MODE_GLOBAL_LOCK;
+    break;
+  case SSTM_BACKEND_NOREC:
+    while ((t->snapshot = ADAPT.seq) & 1) {
+      PAUSE_IN();
+    }
+    tx->mode = SSTM_MODE_NOREC;
+    break;
+  }
+}
+
+/* waits for an even sequence number at which every value we read is
+   still in memory, and returns it; aborts if one changed
+*/
+static size_t norec_validate(sstm_tx_t tx) {
+  array_list_t* log = &tx->adapt.value_log;
+  size_t i;
+
+  while (1) {
+    size_t time = ADAPT.seq;
+    if (time & 1) {
+      PAUSE_IN();
+      continue;
+    }
+    for (i = 0; i < log->size; i++) {
+      if (*log->array[i].address != log->array[i].value) {
+        sstm_tx_abort(tx, 30);
+        return time;
+      }
+    }
+    if (ADAPT.seq == time) {
+      return time;
+    }
+  }
+}
+
+uintptr_t sstm_adapt_load(sstm_tx_t tx, volatile uintptr_t* addr) {
+  if (tx->mode == SSTM_MODE_GLOBAL_LOCK) {
+    return *addr;
+  }
+
+  if (tx->n_lazy > 0) { // our own writes first
+    nodee_t* curr = tx->write_set[hash_address(addr)];
+    for (; curr != NULL; curr = curr->next) {
+      if (curr->record.address == addr) {
+        return curr->record.value;
+      }
+    }
+  }
+
+  // a commit since our snapshot: revalidate and move the snapshot
+  uintptr_t value = *addr;
+  while (tx->adapt.snapshot != ADAPT.seq) {
+    tx->adapt.snapshot = norec_validate(tx);
+    if (tx->aborted) {
+      return value;
+    }
+    value = *addr;
+  }
+  append_array_list(&tx->adapt.value_log, addr, value, 0);
+  return value;
+}
+
+void sstm_adapt_store(sstm_tx_t tx, volatile uintptr_t* addr, uintptr_t val) {
+  if (tx->mode == SSTM_MODE_GLOBAL_LOCK) {
+    append_array_list(&tx->undo_log, addr, *addr, 0);
+    *addr = val;
+  } else {
+    sstm_buffer_write(tx, addr, val);
+  }
+  tx->n_lazy++;
+}
+
+void sstm_adapt_commit(sstm_tx_t tx) {
+  sstm_adapt_thread_t* t = &tx->adapt;
+
+  if (tx->mode == SSTM_MODE_GLOBAL_LOCK) {
+    size_t wake = tx->n_lazy > 0 && sstm_meta_global.n_parked > 0; // under the lock: see sstm_retry.c
+    GL_UNLOCK(&ADAPT.gl_lock);
+    if (wake) {
+      sstm_retry_wake_any();
+    }
+    return;
+  }
+
+  // read-only: the reads were consistent at the snapshot
+  if (tx->n_lazy == 0) {
+    return;
+  }
+
+  while (CAS_U64(&ADAPT.seq, t->snapshot, t->snapshot + 1) != t->snapshot) {
+    t->snapshot = norec_validate(tx);
+    if (tx->aborted) {
+      return;
+    }
+  }
+
+  // once the sequence lock is odd: a retrier that parks later sees it (sstm_retry.c)
+  size_t wake = sstm_meta_global.n_parked > 0;
+  int i;
+  for (i = 0; i < HASH_MODULO; i++) {
+    nodee_t* curr;
+    for (curr = tx->write_set[i]; curr != NULL; curr = curr->next) {
+      *curr->record.address = curr->record.value;
+    }
+  }
+
+  COMPILER_BARRIER();
+  ADAPT.seq = t->snapshot + 2;
+  if (wake) {
+    sstm_retry_wake_any();
+  }
+}
+
+/* waits until no transaction runs, with new ones held back, and changes
+   the backend
+*/
+static void switch_backend(size_t backend) {
+  size_t i;
+
+  ADAPT.switching = 1;
+  __sync_synchronize();
+
+  for (i = 1; i <= sstm_meta_global.n_threads && i < SSTM_MAX_THREADS; i++) {
+    sstm_metadata_t* other = sstm_meta_global.threads[i];
+    while (other != NULL && other->adapt.in_tx) {
+      PAUSE_IN();
+    }
+  }
+
+  ADAPT.backend = backend;
+  ADAPT.n_switches++;
+  COMPILER_BARRIER();
+  ADAPT.switching = 0;
+  // the retriers wait for commits of the previous backend
+  if (sstm_meta_global.n_parked > 0) {
+    sstm_retry_wake_all();
+  }
+}
+
+/* a single thread: nothing to conflict with, the global lock is the
+   cheapest. Many aborts: the global lock, left after a few windows to
+   see if things calmed down. Fewer, mostly from updates: NOrec, whose
+   value-based validation ignores false conflicts on stripes.
+*/
+static size_t choose_backend(size_t commits, size_t aborts, size_t ro_commits) {
+  if (ADAPT.backend == SSTM_BACKEND_GLOBAL_LOCK && sstm_meta_global.n_active > 1) {
+    if (ADAPT.stay > 0) {
+      ADAPT.stay--;
+      return SSTM_BACKEND_GLOBAL_LOCK;
+    }
+    return SSTM_BACKEND_OPTIMISTIC;
+  }
+
+  if (sstm_meta_global.n_active <= 1 || sstm_window_above(aborts, commits + aborts, SSTM_ADAPT_HIGH)) {
+    ADAPT.stay = SSTM_ADAPT_STAY;
+    return SSTM_BACKEND_GLOBAL_LOCK;
+  }
+  if (sstm_window_above(aborts, commits + aborts, SSTM_ADAPT_MEDIUM) && 2 * ro_commits < commits) {
+    return SSTM_BACKEND_NOREC;
+  }
+  return SSTM_BACKEND_OPTIMISTIC;
+}
+
+static void decide(const size_t* counts) {
+  ADAPT.windows[ADAPT.backend]++;
+
+  size_t backend = choose_backend(counts[COMMITS], counts[ABORTS], counts[RO_COMMITS]);
+  if (backend != ADAPT.backend) {
+    PRINTD("ADAPT switch %zu -> %zu\n", ADAPT.backend, backend);
+    switch_backend(backend);
+  }
+}
+
+static void flush(sstm_tx_t tx) {
+  sstm_adapt_thread_t* t = &tx->adapt;
+  size_t counts[N_COUNTS] = { t->commits, tx->n_aborts - t->flushed_aborts, t->ro_commits };
+
+  t->flushed_aborts = tx->n_aborts;
+  t->commits = 0;
+  t->ro_commits = 0;
+  sstm_window_flush(&ADAPT.window, counts, N_COUNTS, SSTM_ADAPT_WINDOW, decide);
+}
+
+void sstm_adapt_commit_end(sstm_tx_t tx, size_t read_only) {
+  sstm_adapt_thread_t* t = &tx->adapt;
+
+  t->value_log.size = 0;
+  COMPILER_BARRIER();
+  t->in_tx = 0;
+
+  t->commits++;
+  t->ro_commits += read_only;
+  if (t->commits >= SSTM_ADAPT_FLUSH) {
+    flush(tx);
+  }
+}
+
+/* the global lock backend writes in place, with the old values in the
+   undo log of write-through mode: restore them, newest first, before
+   anyone else can see memory
+*/
+void sstm_adapt_abort_end(sstm_tx_t tx) {
+  if (tx->mode == SSTM_MODE_GLOBAL_LOCK) {
+    size_t i;
+    for (i = tx->undo_log.size; i-- > 0; ) {
+      *tx->undo_log.array[i].address = tx->undo_log.array[i].value;
+    }
+    tx->undo_log.size = 0;
+    GL_UNLOCK(&ADAPT.gl_lock);
+  }
+  tx->adapt.value_log.size = 0;
+  COMPILER_BARRIER();
+  tx->adapt.in_tx = 0;
+}
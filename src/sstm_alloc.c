@@ -1,7 +1,7 @@
-#include "sstm_alloc.h"
+#include "sstm.h"
 
-__thread sstm_alloc_t sstm_allocator = { .n_allocs = 0 };
-__thread sstm_alloc_t sstm_freeing = { .n_frees = 0 };
+__thread sstm_alloc_t sstm_allocator SSTM_TLS_MODEL = { .n_allocs = 0 };
+__thread sstm_alloc_t sstm_freeing SSTM_TLS_MODEL = { .n_frees = 0 };
 
 /* allocate some memory within a transaction
 */
@@ -20,7 +20,7 @@ sstm_tx_free(void* mem)
 {
   assert(sstm_freeing.n_frees < SSTM_ALLOC_MAX_ALLOCS);
   sstm_tx_store((volatile uintptr_t*) mem, (uintptr_t) 0);
-  sstm_allocator.mem[sstm_freeing.n_frees++] = mem;
+  sstm_freeing.mem[sstm_freeing.n_frees++] = mem;
 }
 
 /* this function is executed when a transaction is aborted.
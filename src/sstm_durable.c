@@ -0,0 +1,447 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sstm.h"
+#include "sstm_futex.h"
+
+/* Durable transactions.
+ *
+ * A writer that validated reserves an entry at the tail of a redo log
+ * mapped from a file, writes back, then fills the entry with the new
+ * values of the words it wrote in the durable regions, all while holding
+ * its locks: conflicting transactions log in the order they commit. An
+ * entry is its end, a checksum and (region/offset, value) pairs; it is
+ * complete once its end is stored. A flusher thread gathers the complete
+ * entries for window_us, msyncs them as a group and wakes the committers
+ * that wait for them.
+ *
+ * When half of the log is used, the flusher copies the regions to a
+ * checkpoint file while writers keep running. The copy starts after the
+ * complete entries and is fixed by replaying those that follow it: the
+ * checkpoint is installed once the entries reserved before the copy
+ * ended are flushed. The log before the checkpoint is then zeroed and
+ * reused. sstm_start() loads the checkpoint and replays the entries of
+ * the same run that checksum, up to the first that does not.
+ */
+
+#define DURABLE (sstm_meta_global.durable)
+#define ENTRY_PAD ((uint64_t) 1 << 63) /* the end of an entry that skips to the start of the log */
+#define KEY_REGION_SHIFT 48
+#define CKPT_MAGIC 0x5353544d44555241ULL
+
+typedef struct ckpt_header
+{
+  uint64_t magic;
+  uint64_t incarnation;
+  uint64_t lsn;			/* replay from */
+  uint64_t n_regions;
+  uint64_t lens[SSTM_DURABLE_MAX_REGIONS];
+} ckpt_header_t;
+
+static inline uint64_t mix(uint64_t h, uint64_t v) {
+  h = (h ^ v) * 0x9e3779b97f4a7c15ULL;
+  return h ^ (h >> 32);
+}
+
+static uint64_t checksum(uint64_t incarnation, size_t lsn, const uint64_t* words, size_t n, uint64_t end) {
+  uint64_t h = mix(incarnation, lsn);
+  size_t i;
+  for (i = 0; i < n; i++) {
+    h = mix(h, words[i]);
+  }
+  return mix(h, end);
+}
+
+static void write_all(int fd, const void* buf, size_t len, const char* path) {
+  const uint8_t* p = buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      perror(path);
+      exit(1);
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+void sstm_durable_enable(const char* path, size_t window_us) {
+  DURABLE.path = strdup(path);
+  DURABLE.ckpt_path = malloc(strlen(path) + sizeof(".ckpt.tmp"));
+  DURABLE.tmp_path = malloc(strlen(path) + sizeof(".ckpt.tmp"));
+  sprintf(DURABLE.ckpt_path, "%s.ckpt", path);
+  sprintf(DURABLE.tmp_path, "%s.ckpt.tmp", path);
+  DURABLE.window_us = window_us;
+  DURABLE.enabled = 1;
+}
+
+void sstm_durable_region(void* base, size_t len) {
+  assert(DURABLE.n_regions < SSTM_DURABLE_MAX_REGIONS);
+  DURABLE.regions[DURABLE.n_regions].start = (uintptr_t) base;
+  DURABLE.regions[DURABLE.n_regions].len = len;
+  DURABLE.n_regions++;
+}
+
+void sstm_durable_print_stats() {
+  if (!DURABLE.enabled) {
+    return;
+  }
+  printf("# Durable: %-10zu commits in %zu flushes (%.1f per flush), %zu checkpoints, %zu recovered\n",
+         DURABLE.n_logged, DURABLE.n_flushes, DURABLE.n_flushes ? (double) DURABLE.n_logged / DURABLE.n_flushes : 0.0,
+         DURABLE.n_checkpoints, DURABLE.n_recovered);
+}
+
+/* writes the header and a (fuzzy) copy of the regions to the temporary
+   checkpoint; returns its descriptor */
+static int open_checkpoint(size_t lsn) {
+  ckpt_header_t header = { CKPT_MAGIC, DURABLE.incarnation, lsn, DURABLE.n_regions, { 0 } };
+  size_t i;
+  int fd = open(DURABLE.tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0) {
+    perror(DURABLE.tmp_path);
+    exit(1);
+  }
+  for (i = 0; i < DURABLE.n_regions; i++) {
+    header.lens[i] = DURABLE.regions[i].len;
+  }
+  write_all(fd, &header, sizeof(header), DURABLE.tmp_path);
+  for (i = 0; i < DURABLE.n_regions; i++) {
+    write_all(fd, (void*) DURABLE.regions[i].start, DURABLE.regions[i].len, DURABLE.tmp_path);
+  }
+  return fd;
+}
+
+static void install_checkpoint(int fd) {
+  fdatasync(fd);
+  close(fd);
+  if (rename(DURABLE.tmp_path, DURABLE.ckpt_path) != 0) {
+    perror(DURABLE.ckpt_path);
+    exit(1);
+  }
+}
+
+/* loads the checkpoint, if it matches the regions; returns 0 otherwise */
+static int load_checkpoint(ckpt_header_t* header) {
+  size_t i;
+  int fd = open(DURABLE.ckpt_path, O_RDONLY);
+
+  if (fd < 0) {
+    return 0;
+  }
+  int ok = read(fd, header, sizeof(*header)) == sizeof(*header)
+    && header->magic == CKPT_MAGIC && header->n_regions == DURABLE.n_regions;
+  for (i = 0; ok && i < DURABLE.n_regions; i++) {
+    ok = header->lens[i] == DURABLE.regions[i].len;
+  }
+  for (i = 0; ok && i < DURABLE.n_regions; i++) {
+    ok = read(fd, (void*) DURABLE.regions[i].start, DURABLE.regions[i].len) == (ssize_t) DURABLE.regions[i].len;
+  }
+  close(fd);
+  if (!ok) {
+    fprintf(stderr, "%s does not match the durable regions: ignored\n", DURABLE.ckpt_path);
+  }
+  return ok;
+}
+
+/* applies the entries of the given run from lsn on, up to the first
+   one that is incomplete */
+static void replay(const uint8_t* ring, size_t capacity, uint64_t incarnation, size_t lsn) {
+  size_t pos = lsn;
+
+  while (1) {
+    size_t off = pos % capacity;
+    const uint64_t* entry = (const uint64_t*) (ring + off);
+    if (off + 2 * sizeof(uint64_t) > capacity) {
+      break;
+    }
+    uint64_t end = entry[0] & ~ENTRY_PAD;
+    if (end <= pos || end - pos > capacity - off) {
+      break;
+    }
+    size_t n = (entry[0] & ENTRY_PAD) ? 0 : (end - pos) / sizeof(uint64_t) - 2;
+    if (checksum(incarnation, pos, entry + 2, n, entry[0]) != entry[1]) {
+      break;
+    }
+    size_t i;
+    for (i = 0; i < n; i += 2) {
+      size_t region = entry[2 + i] >> KEY_REGION_SHIFT;
+      size_t offset = (entry[2 + i] & (((uint64_t) 1 << KEY_REGION_SHIFT) - 1)) * sizeof(uintptr_t);
+      if (region < DURABLE.n_regions && offset < DURABLE.regions[region].len) {
+        *(uintptr_t*) (DURABLE.regions[region].start + offset) = entry[3 + i];
+      }
+    }
+    DURABLE.n_recovered += n > 0;
+    pos = end;
+  }
+}
+
+/* msyncs the log between two positions */
+static void sync_range(size_t from, size_t to) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t a = from % DURABLE.capacity, b = to % DURABLE.capacity;
+
+  if (a < b) {
+    msync(DURABLE.ring + (a & ~(page - 1)), b - (a & ~(page - 1)), MS_SYNC);
+    return;
+  }
+  msync(DURABLE.ring + (a & ~(page - 1)), DURABLE.capacity - (a & ~(page - 1)), MS_SYNC);
+  if (b > 0) {
+    msync(DURABLE.ring, b, MS_SYNC);
+  }
+}
+
+/* flushes the complete entries that follow done and wakes their committers */
+static void flush() {
+  size_t pos = DURABLE.done, tail = DURABLE.tail, n = 0;
+
+  while (pos < tail) {
+    uint64_t end = __atomic_load_n((uint64_t*) (DURABLE.ring + pos % DURABLE.capacity), __ATOMIC_ACQUIRE);
+    if ((end & ~ENTRY_PAD) <= pos) { // still being filled
+      break;
+    }
+    n += !(end & ENTRY_PAD);
+    pos = end & ~ENTRY_PAD;
+  }
+  if (pos == DURABLE.done) {
+    return;
+  }
+  sync_range(DURABLE.done, pos);
+  DURABLE.n_flushes++;
+  DURABLE.n_logged += n;
+  DURABLE.done = pos;
+  __sync_fetch_and_add(&DURABLE.flushed, 1);
+  futex(&DURABLE.flushed, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+}
+
+/* zeroes the log between two positions: a reused entry is complete only
+   once written again */
+static void zero_range(size_t from, size_t to) {
+  size_t a = from % DURABLE.capacity, b = to % DURABLE.capacity;
+
+  if (from == to) {
+    return;
+  }
+  if (a < b) {
+    memset(DURABLE.ring + a, 0, b - a);
+  } else {
+    memset(DURABLE.ring + a, 0, DURABLE.capacity - a);
+    memset(DURABLE.ring, 0, b);
+  }
+}
+
+static void checkpoint() {
+  size_t lsn = DURABLE.done; // the write-backs of the entries before are over
+  int fd = open_checkpoint(lsn);
+  size_t copied = DURABLE.tail; // the writes we may have copied are reserved before
+
+  while (DURABLE.done < copied) {
+    flush();
+    if (DURABLE.done < copied) {
+      sched_yield();
+    }
+  }
+  install_checkpoint(fd);
+  zero_range(DURABLE.ckpt_lsn, lsn);
+  __sync_synchronize();
+  DURABLE.ckpt_lsn = lsn;
+  DURABLE.n_checkpoints++;
+}
+
+static void* flusher(void* arg) {
+  struct timespec idle = { 0, SSTM_DURABLE_IDLE_MS * 1000000 };
+
+  while (1) {
+    // also when the log is full and every entry flushed
+    if (DURABLE.tail - DURABLE.ckpt_lsn > DURABLE.capacity / 2) {
+      checkpoint();
+      continue;
+    }
+    if (DURABLE.done == DURABLE.tail) {
+      if (DURABLE.stop) {
+        break;
+      }
+      DURABLE.idle = 1;
+      __sync_synchronize();
+      if (DURABLE.done == DURABLE.tail && !DURABLE.stop) {
+        futex(&DURABLE.idle, FUTEX_WAIT_PRIVATE, 1, &idle);
+      }
+      DURABLE.idle = 0;
+      continue;
+    }
+    // let the group grow
+    if (DURABLE.window_us > 0) {
+      usleep(DURABLE.window_us);
+    } else {
+      sched_yield();
+    }
+    flush();
+  }
+  return NULL;
+}
+
+static void kick_flusher() {
+  if (DURABLE.idle) {
+    DURABLE.idle = 0;
+    futex(&DURABLE.idle, FUTEX_WAKE_PRIVATE, 1, NULL);
+  }
+}
+
+void sstm_durable_start() {
+  ckpt_header_t header;
+  struct stat st;
+
+  DURABLE.fd = open(DURABLE.path, O_RDWR | O_CREAT, 0644);
+  if (DURABLE.fd < 0 || fstat(DURABLE.fd, &st) != 0) {
+    perror(DURABLE.path);
+    exit(1);
+  }
+
+  // the state of the last run, then a checkpoint of it for this run
+  DURABLE.incarnation = 1;
+  if (load_checkpoint(&header)) {
+    if (st.st_size > 0) {
+      uint8_t* ring = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, DURABLE.fd, 0);
+      assert(ring != MAP_FAILED);
+      replay(ring, st.st_size, header.incarnation, header.lsn);
+      munmap(ring, st.st_size);
+    }
+    DURABLE.incarnation = header.incarnation + 1;
+  }
+  install_checkpoint(open_checkpoint(0));
+
+  // an empty log: its zeroes are incomplete entries
+  DURABLE.capacity = SSTM_DURABLE_LOG_SIZE;
+  if (ftruncate(DURABLE.fd, 0) != 0 || ftruncate(DURABLE.fd, DURABLE.capacity) != 0) {
+    perror(DURABLE.path);
+    exit(1);
+  }
+  DURABLE.ring = mmap(NULL, DURABLE.capacity, PROT_READ | PROT_WRITE, MAP_SHARED, DURABLE.fd, 0);
+  assert(DURABLE.ring != MAP_FAILED);
+  DURABLE.tail = DURABLE.done = DURABLE.ckpt_lsn = 0;
+  DURABLE.stop = 0;
+  pthread_create(&DURABLE.flusher, NULL, flusher, NULL);
+}
+
+void sstm_durable_stop() {
+  DURABLE.stop = 1;
+  DURABLE.idle = 0;
+  futex(&DURABLE.idle, FUTEX_WAKE_PRIVATE, 1, NULL);
+  pthread_join(DURABLE.flusher, NULL);
+  munmap(DURABLE.ring, DURABLE.capacity);
+  close(DURABLE.fd);
+  free(DURABLE.path);
+  free(DURABLE.ckpt_path);
+  free(DURABLE.tmp_path);
+  DURABLE.enabled = 0;
+}
+
+static void add_word(sstm_durable_thread_t* t, volatile uintptr_t* addr) {
+  size_t i;
+
+  for (i = 0; i < DURABLE.n_regions; i++) {
+    uintptr_t off = (uintptr_t) addr - DURABLE.regions[i].start;
+    if (off < DURABLE.regions[i].len) {
+      if (t->n_words == t->capacity) {
+        t->capacity = t->capacity ? 2 * t->capacity : 64;
+        t->words = realloc(t->words, t->capacity * sizeof(sstm_durable_word_t));
+      }
+      t->words[t->n_words].address = addr;
+      t->words[t->n_words].key = ((uint64_t) i << KEY_REGION_SHIFT) | (off / sizeof(uintptr_t));
+      t->n_words++;
+      return;
+    }
+  }
+}
+
+void sstm_durable_reserve(sstm_tx_t tx) {
+  sstm_durable_thread_t* t = &tx->durable;
+  size_t i;
+
+  t->n_words = 0;
+  if (sstm_meta_global.write_through) {
+    for (i = 0; i < tx->undo_log.size; i++) {
+      add_word(t, tx->undo_log.array[i].address);
+    }
+  } else {
+    for (i = 0; i < HASH_MODULO; i++) {
+      nodee_t* curr;
+      for (curr = tx->write_set[i]; curr != NULL; curr = curr->next) {
+        add_word(t, curr->record.address);
+      }
+    }
+  }
+  for (i = 0; i < tx->add_log.size; i++) {
+    add_word(t, tx->add_log.array[i].address);
+  }
+  if (t->n_words == 0) {
+    return;
+  }
+
+  size_t bytes = (2 + 2 * t->n_words) * sizeof(uint64_t);
+  assert(bytes <= DURABLE.capacity / 2);
+  while (1) {
+    size_t tail = DURABLE.tail, off = tail % DURABLE.capacity;
+    size_t pad = off + bytes > DURABLE.capacity ? DURABLE.capacity - off : 0;
+    if (tail + pad + bytes - DURABLE.ckpt_lsn > DURABLE.capacity) { // full until the next checkpoint
+      kick_flusher();
+      sched_yield();
+      continue;
+    }
+    if (CAS_U64(&DURABLE.tail, tail, tail + pad + bytes) == tail) {
+      if (pad > 0) {
+        uint64_t* entry = (uint64_t*) (DURABLE.ring + off);
+        entry[1] = checksum(DURABLE.incarnation, tail, NULL, 0, (tail + pad) | ENTRY_PAD);
+        __atomic_store_n(&entry[0], (tail + pad) | ENTRY_PAD, __ATOMIC_RELEASE);
+      }
+      t->lsn = tail + pad;
+      return;
+    }
+  }
+}
+
+void sstm_durable_append(sstm_tx_t tx) {
+  sstm_durable_thread_t* t = &tx->durable;
+  size_t i;
+
+  if (t->n_words == 0) {
+    return;
+  }
+  uint64_t* entry = (uint64_t*) (DURABLE.ring + t->lsn % DURABLE.capacity);
+  for (i = 0; i < t->n_words; i++) {
+    entry[2 + 2 * i] = t->words[i].key;
+    entry[3 + 2 * i] = *t->words[i].address;
+  }
+  size_t end = t->lsn + (2 + 2 * t->n_words) * sizeof(uint64_t);
+  entry[1] = checksum(DURABLE.incarnation, t->lsn, entry + 2, 2 * t->n_words, end);
+  __atomic_store_n(&entry[0], end, __ATOMIC_RELEASE);
+  t->end = end;
+  t->n_words = 0;
+  kick_flusher();
+}
+
+void sstm_durable_wait(sstm_tx_t tx) {
+  struct timespec timeout = { 0, SSTM_DURABLE_IDLE_MS * 1000000 };
+  size_t end = tx->durable.end;
+
+  tx->durable.end = 0;
+  while (DURABLE.done < end) {
+    uint32_t flushed = DURABLE.flushed;
+    if (DURABLE.done >= end) {
+      break;
+    }
+    futex(&DURABLE.flushed, FUTEX_WAIT_PRIVATE, flushed, &timeout);
+  }
+}
+
+void sstm_durable_thread_stop(sstm_tx_t tx) {
+  free(tx->durable.words);
+  tx->durable.words = NULL;
+  tx->durable.capacity = 0;
+}
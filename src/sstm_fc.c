@@ -0,0 +1,93 @@
+#include <sched.h>
+
+#include "sstm.h"
+
+/* Flat combining.
+ *
+ * A thread publishes its closure in its slot and tries to take the lock
+ * of the group. The thread that gets it becomes the combiner: it
+ * collects the pending closures of the group and runs them one after
+ * the other in a single transaction, then hands the results back. The
+ * others wait for their slot to be served, or for the lock to become
+ * free if the combiner missed them.
+ */
+
+typedef struct sstm_fc_slot
+{
+  volatile size_t pending;
+  size_t group;
+  sstm_fc_fn fn;
+  void* arg;
+  volatile uintptr_t result;
+  uint8_t padding[SSTM_CACHE_LINE - 3 * sizeof(size_t) - sizeof(sstm_fc_fn) - sizeof(void*)];
+} sstm_fc_slot_t;
+
+typedef struct sstm_fc_group
+{
+  ptlock_t lock;
+  uint8_t padding[SSTM_CACHE_LINE - sizeof(ptlock_t)];
+} sstm_fc_group_t;
+
+static sstm_fc_slot_t fc_slots[SSTM_MAX_THREADS];
+static sstm_fc_group_t fc_groups[SSTM_FC_GROUPS];
+static __thread size_t fc_combined SSTM_TLS_MODEL;
+
+/* runs the pending closures of group in one transaction; the caller
+   holds the lock of the group
+*/
+static void combine(size_t group) {
+  sstm_fc_slot_t* batch[SSTM_FC_MAX_BATCH];
+  size_t n = 0, t, i;
+
+  for (t = 1; t <= sstm_meta_global.n_threads && t < SSTM_MAX_THREADS && n < SSTM_FC_MAX_BATCH; t++) {
+    sstm_fc_slot_t* s = &fc_slots[t];
+    if (s->pending && s->group == group) {
+      batch[n++] = s;
+    }
+  }
+
+  // the closures of the batch are retried together if the transaction
+  // conflicts with a thread that is not delegating
+  TX_START();
+  for (i = 0; i < n; i++) {
+    batch[i]->result = batch[i]->fn(batch[i]->arg);
+  }
+  TX_COMMIT();
+
+  for (i = 0; i < n; i++) {
+    batch[i]->pending = 0;
+  }
+  fc_combined += n;
+}
+
+uintptr_t sstm_fc_execute(size_t group, sstm_fc_fn fn, void* arg) {
+  sstm_fc_slot_t* slot = &fc_slots[sstm_meta.id];
+  size_t pauses = 0;
+
+  assert(sstm_meta.id < SSTM_MAX_THREADS);
+  group %= SSTM_FC_GROUPS;
+
+  slot->group = group;
+  slot->fn = fn;
+  slot->arg = arg;
+  COMPILER_BARRIER();
+  slot->pending = 1;
+
+  while (slot->pending) {
+    if (TRYLOCK(&fc_groups[group].lock)) {
+      if (slot->pending) {
+        combine(group);
+      }
+      UNLOCK(&fc_groups[group].lock);
+    } else if (++pauses % SSTM_FC_YIELD == 0) {
+      sched_yield(); // the combiner may not be running
+    } else {
+      PAUSE_IN();
+    }
+  }
+  return slot->result;
+}
+
+size_t sstm_fc_combined() {
+  return fc_combined;
+}
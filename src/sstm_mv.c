@@ -0,0 +1,344 @@
+#include "sstm.h"
+
+/* Multi-version reads.
+ *
+ * Before overwriting a word, a committer pushes the old value on the
+ * version chain of the stripe, tagged with the version of the commit
+ * that supersedes it. A snapshot transaction takes a consistent copy of
+ * the node clocks when it starts; a commit (ts, node) is in the snapshot
+ * iff ts <= snapshot[node]. It reads memory and then walks the chain
+ * back to the value the snapshot sees: it never validates.
+ *
+ * A chain holds at most SSTM_MV_MAX_VERSIONS entries. Past that, the push
+ * trims it to half, at the first entry that every present and future
+ * snapshot sees past (the low-water mark of the snapshots) if it comes
+ * sooner, so a push walks the chain once every SSTM_MV_MAX_VERSIONS / 2
+ * pushes. Entries still needed by a running snapshot may be trimmed: the
+ * chain keeps the newest version they were superseded by, and a reader
+ * whose snapshot is older than that aborts and restarts on the
+ * single-version path. Trimmed entries are freed once the readers
+ * running at that time have finished.
+ */
+
+static inline size_t mv_visible(const volatile size_t* snapshot, size_t version) {
+  return VERSION_TS(version) <= snapshot[VERSION_NODE(version)];
+}
+
+void sstm_mv_enable() {
+  assert(!sstm_meta_global.write_through); // memory holds uncommitted values
+  assert(!sstm_meta_global.adapt.enabled);
+  assert(!sstm_meta_global.resize.enabled);
+  sstm_meta_global.mv_chains = calloc(sstm_meta_global.n_nodes * HASH_MODULO,
+                                      sizeof(sstm_mv_chain_t));
+  sstm_meta_global.mv_enabled = 1;
+}
+
+static void free_chain(sstm_mv_entry_t* e) {
+  while (e != NULL) {
+    sstm_mv_entry_t* next = e->next;
+    free(e);
+    e = next;
+  }
+}
+
+static void free_batch(sstm_mv_batch_t* b) {
+  free_chain(b->chains);
+  free(b->seqs);
+  free(b);
+}
+
+void sstm_mv_stop() {
+  if (!sstm_meta_global.mv_enabled) {
+    return;
+  }
+
+  size_t i;
+  for (i = 0; i < sstm_meta_global.n_nodes * HASH_MODULO; i++) {
+    free_chain(sstm_meta_global.mv_chains[i].head);
+  }
+  free(sstm_meta_global.mv_chains);
+
+  sstm_mv_batch_t* b = sstm_meta_global.mv_orphans;
+  while (b != NULL) {
+    sstm_mv_batch_t* next = b->next;
+    free_batch(b);
+    b = next;
+  }
+  sstm_meta_global.mv_enabled = 0;
+}
+
+/* takes the snapshot: the clocks are collected until two consecutive
+   collects are equal, so that they all held these values at once
+*/
+void sstm_mv_begin(sstm_tx_t tx, size_t mode) {
+  size_t n, again;
+
+  assert(sstm_meta_global.mv_enabled);
+
+  if (tx->mv.fallback) { // the last attempt needed a trimmed version
+    tx->mv.fallback = 0;
+    tx->mode = SSTM_MODE_OPTIMISTIC;
+    return;
+  }
+
+  tx->mode = mode;
+  tx->mv.seq++;
+  tx->mv.active = 1;
+  __sync_synchronize();
+
+  for (n = 0; n < sstm_meta_global.n_nodes; n++) {
+    tx->mv.snapshot[n] = sstm_meta_global.clocks[n].clock;
+  }
+  do {
+    again = 0;
+    for (n = 0; n < sstm_meta_global.n_nodes; n++) {
+      size_t clock = sstm_meta_global.clocks[n].clock;
+      if (clock != tx->mv.snapshot[n]) {
+        tx->mv.snapshot[n] = clock;
+        again = 1;
+      }
+    }
+  } while (again);
+
+  COMPILER_BARRIER();
+  tx->mv.active = 2;
+}
+
+void sstm_mv_end(sstm_tx_t tx) {
+  COMPILER_BARRIER();
+  tx->mv.active = 0;
+  tx->mv.seq++;
+}
+
+/* first committer wins: the stripes we locked must not have been
+   written by a commit that is not in our snapshot
+*/
+size_t sstm_mv_validate_writes(sstm_tx_t tx) {
+  size_t i;
+  for (i = 0; i < tx->lock_set.size; i++) {
+    if (!mv_visible(tx->mv.snapshot, tx->lock_set.array[i].version)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+uintptr_t sstm_mv_load(sstm_tx_t tx, volatile uintptr_t* addr) {
+
+  size_t stripe = sstm_stripe_of(addr);
+  volatile size_t* lock_addr = &sstm_meta_global.lock_table->locks[stripe];
+  uintptr_t value;
+
+  while (1) {
+    size_t lock = *lock_addr;
+
+    if (LOCK_IS_LOCKED(lock)) {
+      // a writer that took its timestamp before our snapshot is in it:
+      // wait for its write-back. Any other writer has not touched memory
+      // yet, or has pushed the old values before overwriting them.
+      sstm_metadata_t* owner = sstm_meta_global.threads[LOCK_OWNER(lock)];
+      if (owner == NULL) { // it has committed and stopped since
+        continue;
+      }
+      size_t cts = owner->commit_ts;
+      if (cts == SSTM_MV_PENDING || (cts != 0 && mv_visible(tx->mv.snapshot, cts))) {
+        PAUSE_IN();
+        continue;
+      }
+      value = *addr;
+      break;
+    }
+
+    value = *addr;
+    if (*lock_addr != lock) {
+      continue;
+    }
+    if (mv_visible(tx->mv.snapshot, lock)) {
+      return value;
+    }
+    break;
+  }
+
+  // walk back to the newest value whose successor is not in the snapshot
+  sstm_mv_chain_t* c = &sstm_meta_global.mv_chains[stripe];
+  sstm_mv_entry_t* e;
+  for (e = c->head; e != NULL; e = e->next) {
+    if (e->address != addr) {
+      continue;
+    }
+    if (mv_visible(tx->mv.snapshot, e->superseded)) {
+      return value;
+    }
+    value = e->value;
+  }
+
+  // the end of the chain: the value is right unless a version the
+  // snapshot needs was trimmed (the horizon is set before the cut)
+  COMPILER_BARRIER();
+  if (!mv_visible(tx->mv.snapshot, c->horizon)) {
+    tx->mv.fallback = 1;
+    sstm_tx_abort(tx, SSTM_MV_TOO_OLD_REASON);
+  }
+  return value;
+}
+
+/* keeps at most half of the chain, up to the first entry everybody sees
+   past, and moves the rest to the open batch
+*/
+static void mv_trim(sstm_tx_t tx, sstm_mv_chain_t* c) {
+  sstm_mv_entry_t* prev = c->head;
+  sstm_mv_entry_t* e = prev->next;
+  size_t kept = 1;
+
+  while (e != NULL && kept < SSTM_MV_MAX_VERSIONS / 2 && !mv_visible(tx->mv.lowwater, e->superseded)) {
+    prev = e;
+    e = e->next;
+    kept++;
+  }
+  c->length = kept;
+  if (e == NULL) {
+    return;
+  }
+
+  if (!mv_visible(tx->mv.lowwater, e->superseded)) { // a snapshot may still need it
+    c->horizon = e->superseded;
+    COMPILER_BARRIER();
+  }
+  prev->next = NULL;
+
+  if (tx->mv.open == NULL) {
+    tx->mv.open = calloc(1, sizeof(sstm_mv_batch_t));
+  }
+  sstm_mv_entry_t* last = e;
+  while (last->next != NULL) {
+    last = last->next;
+  }
+  last->next = tx->mv.open->chains;
+  tx->mv.open->chains = e;
+}
+
+void sstm_mv_push(sstm_tx_t tx, size_t stripe, volatile uintptr_t* addr, size_t superseded) {
+  sstm_mv_entry_t* e = malloc(sizeof(sstm_mv_entry_t));
+  e->address = addr;
+  e->value = *addr;
+  e->superseded = superseded;
+  sstm_mv_chain_t* c = &sstm_meta_global.mv_chains[stripe];
+  e->next = c->head;
+  // the entry must be visible before the value is overwritten
+  COMPILER_BARRIER();
+  c->head = e;
+
+  if (++c->length > SSTM_MV_MAX_VERSIONS) {
+    mv_trim(tx, c);
+  }
+}
+
+/* versions that every present and future snapshot sees: the clocks are
+   read before the snapshots, so a reader that starts later sees more
+*/
+static void mv_lowwater(sstm_tx_t tx) {
+  size_t lw[SSTM_MAX_NODES];
+  size_t n, t;
+
+  for (n = 0; n < sstm_meta_global.n_nodes; n++) {
+    lw[n] = sstm_meta_global.clocks[n].clock;
+  }
+  __sync_synchronize();
+
+  for (t = 1; t <= sstm_meta_global.n_threads && t < SSTM_MAX_THREADS; t++) {
+    sstm_metadata_t* other = sstm_meta_global.threads[t];
+    if (other == NULL) {
+      continue;
+    }
+    size_t active = other->mv.active;
+    if (active == 1) {	// its snapshot is not published: keep the old mark
+      return;
+    }
+    if (active == 2) {
+      for (n = 0; n < sstm_meta_global.n_nodes; n++) {
+        size_t s = other->mv.snapshot[n];
+        if (s < lw[n]) {
+          lw[n] = s;
+        }
+      }
+    }
+  }
+
+  for (n = 0; n < sstm_meta_global.n_nodes; n++) {
+    tx->mv.lowwater[n] = lw[n];
+  }
+}
+
+/* a batch can be freed when no thread is still in the snapshot
+   transaction it was running when the batch was sealed
+*/
+static size_t mv_batch_done(sstm_mv_batch_t* b) {
+  size_t t;
+  for (t = 1; t <= sstm_meta_global.n_threads && t < SSTM_MAX_THREADS; t++) {
+    sstm_metadata_t* other = sstm_meta_global.threads[t];
+    if (other != NULL && (b->seqs[t] & 1) && other->mv.seq == b->seqs[t]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void mv_seal(sstm_tx_t tx) {
+  sstm_mv_batch_t* b = tx->mv.open;
+  size_t t;
+
+  b->seqs = calloc(SSTM_MAX_THREADS, sizeof(size_t));
+  for (t = 1; t <= sstm_meta_global.n_threads && t < SSTM_MAX_THREADS; t++) {
+    sstm_metadata_t* other = sstm_meta_global.threads[t];
+    if (other != NULL) {
+      b->seqs[t] = other->mv.seq;
+    }
+  }
+  b->next = tx->mv.retired;
+  tx->mv.retired = b;
+  tx->mv.open = NULL;
+}
+
+/* frees the oldest retired batches whose readers have moved on */
+static void mv_reclaim(sstm_tx_t tx) {
+  sstm_mv_batch_t** link = &tx->mv.retired;
+
+  while (*link != NULL) {
+    sstm_mv_batch_t* b = *link;
+    if (mv_batch_done(b)) {
+      *link = b->next;
+      free_batch(b);
+    } else {
+      link = &b->next;
+    }
+  }
+}
+
+void sstm_mv_on_commit(sstm_tx_t tx) {
+  if (++tx->mv.n_commits < SSTM_MV_GC_PERIOD) {
+    return;
+  }
+  tx->mv.n_commits = 0;
+
+  if (tx->mv.open != NULL) {
+    mv_seal(tx);
+  }
+  mv_reclaim(tx);
+  mv_lowwater(tx);
+}
+
+/* batches still referenced by running readers are freed at sstm_stop() */
+void sstm_mv_thread_stop(sstm_tx_t tx) {
+  if (tx->mv.open != NULL) {
+    mv_seal(tx);
+  }
+  mv_reclaim(tx);
+
+  while (tx->mv.retired != NULL) {
+    sstm_mv_batch_t* b = tx->mv.retired;
+    tx->mv.retired = b->next;
+    do {
+      b->next = sstm_meta_global.mv_orphans;
+    } while (CAS_PTR(&sstm_meta_global.mv_orphans, b->next, b) != b->next);
+  }
+}
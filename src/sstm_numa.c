@@ -0,0 +1,78 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+
+#include "sstm.h"
+
+/* reads the highest online node id from sysfs ("0", "0-1", "0,2-3", ...)
+*/
+size_t sstm_numa_nodes() {
+  FILE* f = fopen("/sys/devices/system/node/online", "r");
+  if (f == NULL) {
+    return 1;
+  }
+
+  int first, last = 0;
+  char sep;
+  while (fscanf(f, "%d", &first) == 1) {
+    last = first;
+    if (fscanf(f, "%c", &sep) != 1 || sep == '\n') {
+      break;
+    }
+    if (sep == '-' && fscanf(f, "%d", &last) == 1) {
+      if (fscanf(f, "%c", &sep) != 1 || sep == '\n') {
+	break;
+      }
+    }
+  }
+  fclose(f);
+
+  size_t n = last + 1;
+  return n > SSTM_MAX_NODES ? SSTM_MAX_NODES : n;
+}
+
+size_t sstm_numa_current_node() {
+  unsigned cpu, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+    return 0;
+  }
+  return node % sstm_meta_global.n_nodes;
+}
+
+/* mmaps the memory and binds it to node; on a single node machine this
+   is a plain anonymous mapping
+*/
+void* sstm_numa_alloc_on_node(size_t size, size_t node) {
+  void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    perror("sstm_numa_alloc_on_node");
+    exit(1);
+  }
+
+  sstm_numa_bind(mem, size, node);
+  return mem;
+}
+
+void sstm_numa_bind(void* mem, size_t size, size_t node) {
+  if (sstm_meta_global.n_nodes > 1) {
+    unsigned long mask = 1UL << node;
+    // best effort: if binding fails, the first touch decides
+    syscall(SYS_mbind, mem, size, MPOL_BIND, &mask, SSTM_MAX_NODES + 1, 0);
+  }
+}
+
+void sstm_numa_free(void* mem, size_t size) {
+  munmap(mem, size);
+}
+
+void sstm_numa_region(void* base, size_t len, size_t node) {
+  assert(sstm_meta_global.n_regions < SSTM_NUMA_MAX_REGIONS);
+  sstm_numa_region_t* r = &sstm_meta_global.regions[sstm_meta_global.n_regions];
+  r->start = (uintptr_t) base;
+  r->end = (uintptr_t) base + len;
+  r->node = node % sstm_meta_global.n_nodes;
+  sstm_meta_global.n_regions++;
+}
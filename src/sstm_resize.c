@@ -0,0 +1,261 @@
+#include <sched.h>
+
+#include "sstm.h"
+#include "sstm_futex.h"
+
+/* Lock table resizing.
+ *
+ * A store that locks a stripe records its address next to the lock. A
+ * thread that finds the stripe locked by another one compares that
+ * address with its own: a different granule means the two addresses only
+ * share the lock through the modulo (more locks would separate them), a
+ * different word of the same granule means the stripes are too coarse.
+ * Every SSTM_RESIZE_WINDOW commits, the thread that completes the window
+ * picks the size and the shift of the table from these rates, and hands
+ * them to the resizer thread.
+ *
+ * The resizer replaces the table without stopping the threads. It
+ * closes the current one: a writer that locks a stripe afterwards sees
+ * it closed, gives the lock back by aborting and waits for the next
+ * table, and so does a new visible reader. Readers go on. The resizer
+ * waits for the locks taken before the close and for the visible readers
+ * that registered before it (a lock or a reader count, then the state:
+ * one of the two sees the other). Memory then only changes through the
+ * new table, which is published once the old one is marked replaced: a
+ * load in the old table that finds it replaced aborts, as what it read
+ * may be newer than the rest. The transactions that start afterwards use
+ * the new table. The old one is freed once no thread refers to it.
+ */
+
+#define RESIZE (sstm_meta_global.resize)
+
+enum { COMMITS, CONFLICTS, FALSE_TABLE, FALSE_SHIFT, N_COUNTS }; // of a window
+
+static void* resizer(void* arg);
+
+void sstm_resize_enable() {
+  assert(!sstm_meta_global.mv_enabled); // the version chains are per stripe
+  sstm_lock_table_t* table = sstm_meta_global.lock_table;
+  table->writers = calloc(sstm_meta_global.n_nodes * table->size, sizeof(uintptr_t));
+  INIT_LOCK(&RESIZE.window.decide_lock);
+  RESIZE.enabled = 1;
+  pthread_create(&RESIZE.resizer, NULL, resizer, NULL);
+}
+
+void sstm_resize_stop() {
+  RESIZE.stop = 1;
+  __sync_synchronize();
+  futex(&RESIZE.pending, FUTEX_WAKE_PRIVATE, 1, NULL);
+  pthread_join(RESIZE.resizer, NULL);
+}
+
+void sstm_resize_print_stats() {
+  sstm_lock_table_t* table = sstm_meta_global.lock_table;
+
+  if (!RESIZE.enabled) {
+    return;
+  }
+  printf("# Locks  : %-10zu resizes, now %zu locks/node of %zu bytes; "
+         "%zu conflicts, %zu on another granule, %zu on another word\n",
+         RESIZE.n_resizes, table->size, (size_t) 1 << table->shift,
+         RESIZE.total_conflicts, RESIZE.total_false_table, RESIZE.total_false_shift);
+}
+
+void sstm_resize_conflict(sstm_tx_t tx, size_t stripe, volatile uintptr_t* addr) {
+  sstm_lock_table_t* table = tx->lock_table;
+  uintptr_t writer = table->writers[stripe];
+
+  tx->resize.conflicts++;
+  if (writer == 0 || writer == (uintptr_t) addr) {
+    return;
+  }
+  if ((writer >> table->shift) == ((uintptr_t) addr >> table->shift)) {
+    tx->resize.false_shift++;
+  } else {
+    tx->resize.false_table++;
+  }
+}
+
+/* frees the replaced tables that every thread has moved past; a thread
+   takes the current table after it registers, so it is either seen here
+   or reads a table at least as new as the one just published
+*/
+static void reclaim() {
+  size_t oldest = sstm_meta_global.lock_table->epoch, i;
+
+  __sync_synchronize();
+  for (i = 1; i <= sstm_meta_global.n_threads && i < SSTM_MAX_THREADS; i++) {
+    sstm_metadata_t* other = sstm_meta_global.threads[i];
+    if (other == NULL) {
+      continue;
+    }
+    sstm_lock_table_t* table = other->lock_table;
+    if (table == NULL) { // registering
+      return;
+    }
+    if (table->epoch < oldest) {
+      oldest = table->epoch;
+    }
+  }
+
+  sstm_lock_table_t** link = &RESIZE.retired;
+  while (*link != NULL) {
+    sstm_lock_table_t* table = *link;
+    if (table->epoch < oldest) {
+      *link = table->next;
+      sstm_lock_table_free(table);
+    } else {
+      link = &table->next;
+    }
+  }
+}
+
+static inline void resize_pause(size_t* pauses) {
+  if (++*pauses % SSTM_RESIZE_YIELD == 0) {
+    sched_yield(); // the thread we wait for may not be running
+  } else {
+    PAUSE_IN();
+  }
+}
+
+/* closes the current table, waits for its writers and visible readers,
+   and publishes a new one
+*/
+static void resize(size_t size, size_t shift) {
+  sstm_lock_table_t* old = sstm_meta_global.lock_table;
+  sstm_lock_table_t* table = sstm_lock_table_new(size, shift);
+  size_t n = sstm_meta_global.n_nodes * old->size, i, pauses = 0;
+
+  table->epoch = old->epoch + 1;
+  table->writers = calloc(sstm_meta_global.n_nodes * size, sizeof(uintptr_t));
+
+  old->state = SSTM_TABLE_CLOSED;
+  __sync_synchronize();
+  for (i = 0; i < n; i++) {
+    while (LOCK_IS_LOCKED(old->locks[i]) || old->readers[i] > 0) {
+      resize_pause(&pauses);
+    }
+  }
+
+  old->state = SSTM_TABLE_REPLACED;
+  __sync_synchronize();
+  sstm_meta_global.lock_table = table;
+  old->next = RESIZE.retired;
+  RESIZE.retired = old;
+  RESIZE.n_resizes++;
+
+  sstm_retry_wake_all(); // they wait on stripes of the old table
+}
+
+/* applies the geometries the workers decide on, and frees the replaced
+   tables as the threads move past them
+*/
+static void* resizer(void* arg) {
+  struct timespec idle = { SSTM_RESIZE_IDLE_MS / 1000, (SSTM_RESIZE_IDLE_MS % 1000) * 1000000 };
+
+  while (!RESIZE.stop) {
+    if (RESIZE.pending) {
+      resize(RESIZE.next_size, RESIZE.next_shift);
+      __atomic_store_n(&RESIZE.pending, 0, __ATOMIC_RELEASE);
+    }
+    if (RESIZE.retired != NULL) {
+      reclaim();
+    }
+    futex(&RESIZE.pending, FUTEX_WAIT_PRIVATE, 0, &idle);
+  }
+  return NULL;
+}
+
+/* more locks when addresses collide in them, fewer once they have not
+   for a while, but never as few as in a table that had collisions
+   (halving at most doubles them). Finer stripes when words of a granule
+   collide, with twice the locks to cover the same bytes; coarser ones,
+   with half the locks, once they have not for a while, but never as
+   coarse as stripes that had collisions
+*/
+static void decide_geometry(size_t commits, size_t false_table, size_t false_shift) {
+  sstm_lock_table_t* table = sstm_meta_global.lock_table;
+  size_t size = table->size, shift = table->shift;
+
+  if (sstm_window_above(false_table, commits, SSTM_RESIZE_HIGH)) {
+    RESIZE.calm = 0;
+    if (size < SSTM_RESIZE_MAX) {
+      RESIZE.too_small = size;
+      size *= SSTM_RESIZE_GROW;
+    }
+  } else if (!sstm_window_above(8 * false_table, commits, SSTM_RESIZE_HIGH)
+             && size > SSTM_RESIZE_MIN && size / 2 > RESIZE.too_small) {
+    if (++RESIZE.calm >= SSTM_RESIZE_CALM) {
+      RESIZE.calm = 0;
+      size /= 2;
+    }
+  } else {
+    RESIZE.calm = 0;
+  }
+
+  if (sstm_window_above(false_shift, commits, SSTM_RESIZE_HIGH) && shift > SSTM_RESIZE_MIN_SHIFT) {
+    RESIZE.calm_shift = 0;
+    RESIZE.too_coarse = shift;
+    shift--;
+    size *= 2;
+  } else if (!sstm_window_above(8 * false_shift, commits, SSTM_RESIZE_HIGH) && shift < SSTM_RESIZE_MAX_SHIFT
+             && (RESIZE.too_coarse == 0 || shift + 1 < RESIZE.too_coarse)) {
+    if (++RESIZE.calm_shift >= SSTM_RESIZE_CALM) {
+      RESIZE.calm_shift = 0;
+      shift++;
+      if (size / 2 >= SSTM_RESIZE_MIN) {
+        size /= 2;
+      }
+    }
+  } else {
+    RESIZE.calm_shift = 0;
+  }
+
+  if (size > SSTM_RESIZE_MAX) {
+    size = SSTM_RESIZE_MAX;
+  }
+  if (size != table->size || shift != table->shift) {
+    PRINTD("RESIZE %zu locks/node, shift %zu -> %zu locks/node, shift %zu\n",
+           table->size, table->shift, size, shift);
+    RESIZE.next_size = size;
+    RESIZE.next_shift = shift;
+    __atomic_store_n(&RESIZE.pending, 1, __ATOMIC_RELEASE);
+    futex(&RESIZE.pending, FUTEX_WAKE_PRIVATE, 1, NULL);
+  }
+}
+
+static void decide(const size_t* counts) {
+  RESIZE.total_conflicts += counts[CONFLICTS];
+  RESIZE.total_false_table += counts[FALSE_TABLE];
+  RESIZE.total_false_shift += counts[FALSE_SHIFT];
+  if (!RESIZE.pending) { // not while the table is being replaced
+    decide_geometry(counts[COMMITS], counts[FALSE_TABLE], counts[FALSE_SHIFT]);
+  }
+}
+
+static void flush(sstm_tx_t tx) {
+  sstm_resize_thread_t* t = &tx->resize;
+  size_t counts[N_COUNTS] = { tx->n_commits - t->flushed_commits, t->conflicts, t->false_table, t->false_shift };
+
+  t->flushed_commits = tx->n_commits;
+  t->conflicts = t->false_table = t->false_shift = 0;
+  sstm_window_flush(&RESIZE.window, counts, N_COUNTS, SSTM_RESIZE_WINDOW, decide);
+}
+
+void sstm_resize_end(sstm_tx_t tx) {
+  size_t pauses = 0;
+
+  if (tx->n_commits - tx->resize.flushed_commits >= SSTM_RESIZE_FLUSH) {
+    flush(tx);
+  }
+  // our writes go to the next table, as soon as it is published
+  if (tx->resize.blocked) {
+    while (sstm_meta_global.lock_table == tx->lock_table) {
+      resize_pause(&pauses);
+    }
+    tx->resize.blocked = 0;
+  }
+  // the accesses to the previous table are done
+  COMPILER_BARRIER();
+  tx->lock_table = sstm_meta_global.lock_table;
+}
@@ -0,0 +1,168 @@
+#include <limits.h>
+
+#include "sstm.h"
+#include "sstm_futex.h"
+
+/* Blocking retry.
+ *
+ * A retrier publishes what it waits for and aborts. It sleeps at the end
+ * of the abort, once it has given back everything it held: its stripe
+ * locks, the global lock, its visible reads. It waits in one of two ways.
+ *
+ * On stripes: an optimistic transaction or a visible reader marks the
+ * stripes of its read set in a bitmap and publishes it (parked, then
+ * n_parked). A committing writer reads n_parked after it has locked its
+ * stripes and before it releases them: either it sees the retrier and,
+ * after the write-back, wakes it if one of its stripes is marked, or the
+ * retrier, which validates after publishing, sees the stripe locked or
+ * with a new version and does not sleep. Visible reads cannot have
+ * changed: their writer waits for the reader to leave, which it does
+ * after publishing.
+ *
+ * On any commit: snapshots, the global lock and NOrec backends do not
+ * know the stripes they read, and a transaction that read nothing has no
+ * stripe to wait on. They sleep on the retry_seq futex word, which every
+ * writing commit that sees n_parked bumps. Before sleeping, a snapshot
+ * checks that no clock moved since it was taken, NOrec that the sequence
+ * lock did not; under the global lock nothing commits until we leave it.
+ *
+ * A resize and a backend switch wake every parked thread: the marks
+ * index the old table, or the commits they wait for now take another
+ * path.
+ */
+
+static void wake(sstm_tx_t other) {
+  other->retry.wake = 1;
+  futex(&other->retry.wake, FUTEX_WAKE_PRIVATE, 1, NULL);
+}
+
+void sstm_retry_wake_any() {
+  if (sstm_meta_global.n_parked_any > 0) {
+    __sync_fetch_and_add(&sstm_meta_global.retry_seq, 1);
+    futex(&sstm_meta_global.retry_seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+  }
+}
+
+void sstm_retry_wake_all() {
+  size_t i;
+  for (i = 1; i <= sstm_meta_global.n_threads && i < SSTM_MAX_THREADS; i++) {
+    sstm_metadata_t* other = sstm_meta_global.threads[i];
+    if (other != NULL && other->retry.parked) {
+      wake(other);
+    }
+  }
+  sstm_retry_wake_any();
+}
+
+void sstm_retry_wake(sstm_tx_t tx) {
+  size_t i, j;
+
+  for (i = 1; i <= sstm_meta_global.n_threads && i < SSTM_MAX_THREADS; i++) {
+    sstm_metadata_t* other = sstm_meta_global.threads[i];
+    if (other == NULL || !other->retry.parked || other->retry.table != tx->lock_table) {
+      continue;
+    }
+    for (j = 0; j < tx->lock_set.size; j++) {
+      size_t stripe = (volatile size_t*) tx->lock_set.array[j].address - tx->lock_table->locks;
+      if (other->retry.marks[stripe / 64] & ((uint64_t) 1 << (stripe % 64))) {
+        wake(other);
+        break;
+      }
+    }
+  }
+  sstm_retry_wake_any();
+}
+
+/* nothing committed since the transaction read what it did: the commits
+   that follow see n_parked */
+static int unchanged(sstm_tx_t tx) {
+  size_t n;
+
+  switch (tx->mode) {
+  case SSTM_MODE_SNAPSHOT:
+  case SSTM_MODE_SI:
+    for (n = 0; n < sstm_meta_global.n_nodes; n++) {
+      if (sstm_meta_global.clocks[n].clock != tx->mv.snapshot[n]) {
+        return 0;
+      }
+    }
+    return 1;
+  case SSTM_MODE_NOREC:
+    return tx->adapt.snapshot == sstm_meta_global.adapt.seq;
+  default: // we hold the global lock, or read nothing
+    return 1;
+  }
+}
+
+void sstm_tx_retry(sstm_tx_t tx) {
+  sstm_retry_thread_t* r = &tx->retry;
+  read_set_t* rs = &tx->read_set;
+  size_t i;
+
+  if (tx->aborted) {
+    return;
+  }
+  r->pending = 1;
+  r->wake = 0;
+
+  if (rs->size > 0 && (tx->mode == SSTM_MODE_OPTIMISTIC || tx->mode == SSTM_MODE_VISIBLE)) {
+    if (r->marks == NULL) { // for the largest table: writers may read them at any time
+      r->marks = calloc(sstm_meta_global.n_nodes * SSTM_RESIZE_MAX / 64, sizeof(uint64_t));
+    }
+    for (i = 0; i < rs->size; i++) {
+      r->marks[rs->stripes[i] / 64] |= (uint64_t) 1 << (rs->stripes[i] % 64);
+    }
+    r->n_marked = rs->size;
+    r->table = tx->lock_table;
+    r->parked = 1;
+    IAF_U64(&sstm_meta_global.n_parked);
+    // a table published before we parked, or a write since we read
+    r->wake = sstm_meta_global.lock_table != r->table
+      || (tx->mode == SSTM_MODE_OPTIMISTIC && !validate(tx));
+  } else {
+    r->any = 1;
+    IAF_U64(&sstm_meta_global.n_parked_any);
+    IAF_U64(&sstm_meta_global.n_parked);
+    r->seq = sstm_meta_global.retry_seq;
+    r->wake = !unchanged(tx);
+  }
+
+  sstm_tx_abort(tx, SSTM_RETRY_REASON);
+}
+
+void sstm_retry_park(sstm_tx_t tx) {
+  sstm_retry_thread_t* r = &tx->retry;
+  size_t i;
+
+  if (r->any) {
+    while (!r->wake && sstm_meta_global.retry_seq == r->seq) {
+      futex(&sstm_meta_global.retry_seq, FUTEX_WAIT_PRIVATE, r->seq, NULL);
+    }
+    r->any = 0;
+    __sync_fetch_and_sub(&sstm_meta_global.n_parked, 1);
+    __sync_fetch_and_sub(&sstm_meta_global.n_parked_any, 1);
+    return;
+  }
+
+  while (!r->wake) {
+    futex(&r->wake, FUTEX_WAIT_PRIVATE, 0, NULL);
+  }
+  r->parked = 0;
+  __sync_fetch_and_sub(&sstm_meta_global.n_parked, 1);
+  // the read set was cleared by the abort, but its entries are still there
+  for (i = 0; i < r->n_marked; i++) {
+    r->marks[tx->read_set.stripes[i] / 64] = 0;
+  }
+}
+
+void sstm_retry_thread_stop(sstm_tx_t tx) {
+  __sync_fetch_and_add(&sstm_meta_global.n_retries, tx->retry.n_retries);
+  free(tx->retry.marks);
+  tx->retry.marks = NULL;
+}
+
+void sstm_retry_print_stats() {
+  if (sstm_meta_global.n_retries > 0) {
+    printf("# Retries: %-10zu\n", sstm_meta_global.n_retries);
+  }
+}
@@ -0,0 +1,188 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sstm.h"
+
+/* Online snapshots.
+ *
+ * A committing writer publishes the snapshot epoch it read once it holds
+ * its locks and before it validates, and clears it after its write-back
+ * or a failed validation. A snapshot bumps the epoch: the writers that
+ * read an older one commit before the snapshot, the others after it. A
+ * transaction that depends on another, or that overwrites what another
+ * read, locked its stripes after the other validated: it never gets the
+ * older epoch. The snapshot waits for the older write-backs to
+ * finish, then copies the regions block by block. A newer writer first
+ * copies the blocks it is about to write, unless that is done already;
+ * whoever claims a block copies it, the other waits. The copy is thus the
+ * state between the two epochs, and nobody stops: a writer copies at
+ * most its own blocks once.
+ */
+
+#define SNAPSHOT (sstm_meta_global.snapshot)
+
+enum { BLOCK_PENDING, BLOCK_COPYING, BLOCK_COPIED };
+
+/* the thread we wait for may not be running */
+static inline void wait_pause(size_t* pauses) {
+  if (++*pauses % SSTM_SNAPSHOT_YIELD == 0) {
+    sched_yield();
+  } else {
+    PAUSE_IN();
+  }
+}
+
+void sstm_snapshot_region(void* base, size_t len) {
+  sstm_snapshot_region_t* r = &SNAPSHOT.regions[SNAPSHOT.n_regions];
+
+  assert(SNAPSHOT.n_regions < SSTM_SNAPSHOT_MAX_REGIONS);
+  if (SNAPSHOT.n_regions == 0) {
+    pthread_mutex_init(&SNAPSHOT.lock, NULL);
+    SNAPSHOT.epoch = 1;
+  }
+  r->start = (uintptr_t) base;
+  r->len = len;
+  r->block = SNAPSHOT.n_blocks;
+  r->offset = SNAPSHOT.size;
+  SNAPSHOT.n_blocks += (len + (1 << SSTM_SNAPSHOT_BLOCK_SHIFT) - 1) >> SSTM_SNAPSHOT_BLOCK_SHIFT;
+  SNAPSHOT.size += len;
+  SNAPSHOT.n_regions++;
+  free((void*) SNAPSHOT.blocks);
+  SNAPSHOT.blocks = calloc(SNAPSHOT.n_blocks, sizeof(uint8_t));
+}
+
+size_t sstm_snapshot_size() {
+  return SNAPSHOT.size;
+}
+
+void sstm_snapshot_print_stats() {
+  if (SNAPSHOT.n_snapshots > 0) {
+    printf("# Snapshots: %-10zu %zu blocks copied by writers\n", SNAPSHOT.n_snapshots, SNAPSHOT.n_cow);
+  }
+}
+
+/* copies block b of region r, unless someone else does */
+static void copy_block(sstm_snapshot_region_t* r, size_t b) {
+  volatile uint8_t* state = &SNAPSHOT.blocks[r->block + b];
+  size_t pauses = 0;
+  size_t off = b << SSTM_SNAPSHOT_BLOCK_SHIFT;
+  size_t len = r->len - off < (1 << SSTM_SNAPSHOT_BLOCK_SHIFT) ? r->len - off : (1 << SSTM_SNAPSHOT_BLOCK_SHIFT);
+
+  if (*state == BLOCK_COPIED) {
+    return;
+  }
+  if (__sync_bool_compare_and_swap(state, BLOCK_PENDING, BLOCK_COPYING)) {
+    memcpy(SNAPSHOT.copy + r->offset + off, (void*) (r->start + off), len);
+    __atomic_store_n(state, BLOCK_COPIED, __ATOMIC_RELEASE);
+    return;
+  }
+  while (*state != BLOCK_COPIED) {
+    wait_pause(&pauses);
+  }
+}
+
+/* the block of addr is copied before we write it */
+static size_t copy_before_write(volatile uintptr_t* addr) {
+  size_t i;
+
+  for (i = 0; i < SNAPSHOT.n_regions; i++) {
+    sstm_snapshot_region_t* r = &SNAPSHOT.regions[i];
+    uintptr_t off = (uintptr_t) addr - r->start;
+    if (off < r->len) {
+      size_t b = off >> SSTM_SNAPSHOT_BLOCK_SHIFT;
+      if (SNAPSHOT.blocks[r->block + b] == BLOCK_COPIED) {
+        return 0;
+      }
+      copy_block(r, b);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void sstm_snapshot_commit(sstm_tx_t tx) {
+  size_t epoch, i, n = 0, pauses = 0;
+
+  // a snapshot that bumps the epoch after we published the old one waits for us
+  do {
+    epoch = SNAPSHOT.epoch;
+    tx->snapshot.epoch = epoch;
+    __sync_synchronize();
+  } while (epoch != SNAPSHOT.epoch);
+
+  // the older write-backs may touch our blocks
+  while (SNAPSHOT.copying == epoch && !SNAPSHOT.drained) {
+    wait_pause(&pauses);
+  }
+  if (SNAPSHOT.copying != epoch) { // none, or it is over: all is copied
+    return;
+  }
+  for (i = 0; i < HASH_MODULO; i++) {
+    nodee_t* curr;
+    for (curr = tx->write_set[i]; curr != NULL; curr = curr->next) {
+      n += copy_before_write(curr->record.address);
+    }
+  }
+  for (i = 0; i < tx->add_log.size; i++) {
+    n += copy_before_write(tx->add_log.array[i].address);
+  }
+  if (n > 0) {
+    __sync_fetch_and_add(&SNAPSHOT.n_cow, n);
+  }
+}
+
+void sstm_snapshot_commit_end(sstm_tx_t tx) {
+  __atomic_store_n(&tx->snapshot.epoch, 0, __ATOMIC_RELEASE);
+}
+
+void sstm_snapshot_take(void* buf) {
+  size_t i, b, epoch;
+
+  // memory holds values that may not commit
+  assert(!sstm_meta_global.write_through && !sstm_meta_global.adapt.enabled);
+  pthread_mutex_lock(&SNAPSHOT.lock);
+  SNAPSHOT.drained = 0;
+  SNAPSHOT.copying = SNAPSHOT.epoch + 1;
+  epoch = IAF_U64(&SNAPSHOT.epoch);
+
+  // the commits of the older epochs finish their write-back, and those
+  // of the last snapshot stop looking at the blocks
+  for (i = 1; i <= sstm_meta_global.n_threads && i < SSTM_MAX_THREADS; i++) {
+    sstm_metadata_t* other = sstm_meta_global.threads[i];
+    while (other != NULL && other->snapshot.epoch != 0 && other->snapshot.epoch < epoch) {
+      sched_yield();
+    }
+  }
+  memset((void*) SNAPSHOT.blocks, BLOCK_PENDING, SNAPSHOT.n_blocks);
+  SNAPSHOT.copy = buf;
+  __sync_synchronize();
+  SNAPSHOT.drained = 1;
+
+  for (i = 0; i < SNAPSHOT.n_regions; i++) {
+    sstm_snapshot_region_t* r = &SNAPSHOT.regions[i];
+    for (b = 0; b << SSTM_SNAPSHOT_BLOCK_SHIFT < r->len; b++) {
+      copy_block(r, b);
+    }
+  }
+
+  SNAPSHOT.copying = 0;
+  SNAPSHOT.n_snapshots++;
+  pthread_mutex_unlock(&SNAPSHOT.lock);
+}
+
+void sstm_snapshot_write(const char* path) {
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0 || ftruncate(fd, SNAPSHOT.size) != 0) {
+    perror(path);
+    exit(1);
+  }
+  void* buf = mmap(NULL, SNAPSHOT.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(buf != MAP_FAILED);
+  sstm_snapshot_take(buf);
+  munmap(buf, SNAPSHOT.size);
+  close(fd);
+}
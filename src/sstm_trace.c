@@ -0,0 +1,86 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sstm.h"
+#include "random.h"
+
+/* Event tracing.
+ *
+ * Every thread writes fixed-size binary events to its own ring, a slice
+ * of a file mapped by all of them, and publishes how many it wrote in
+ * the header of the file: recording is a few stores, with no lock and no
+ * formatting. The file holds the last SSTM_TRACE_EVENTS events of each
+ * thread when the program ends (or is killed). trace_report reads it.
+ */
+
+static sstm_trace_header_t* trace_file;
+static size_t trace_bytes;
+
+#define TRACE_RING(id) ((sstm_trace_event_t*) (trace_file + 1) + (id) * SSTM_TRACE_EVENTS)
+
+/* ticks of getticks() per microsecond, over 10ms */
+static uint64_t ticks_per_us() {
+  struct timespec t0, t1, pause = { 0, 10000000 };
+  uint64_t c0, c1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  c0 = getticks();
+  nanosleep(&pause, NULL);
+  c1 = getticks();
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (c1 - c0) * 1000 / ((t1.tv_sec - t0.tv_sec) * 1000000000 + (t1.tv_nsec - t0.tv_nsec));
+}
+
+void sstm_trace_enable(const char* path) {
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+  // sparse: only the rings of the threads that ran take space
+  trace_bytes = sizeof(sstm_trace_header_t)
+    + (size_t) SSTM_TRACE_THREADS * SSTM_TRACE_EVENTS * sizeof(sstm_trace_event_t);
+  if (fd < 0 || ftruncate(fd, trace_bytes) != 0) {
+    perror(path);
+    exit(1);
+  }
+  trace_file = mmap(NULL, trace_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(trace_file != MAP_FAILED);
+  close(fd);
+  trace_file->ticks_per_us = ticks_per_us();
+  trace_file->n_events = SSTM_TRACE_EVENTS;
+  trace_file->n_slots = SSTM_TRACE_THREADS;
+  trace_file->magic = SSTM_TRACE_MAGIC;
+}
+
+void sstm_trace_stop() {
+  if (trace_file != NULL) {
+    munmap(trace_file, trace_bytes);
+    trace_file = NULL;
+  }
+}
+
+void sstm_trace_thread_start(sstm_tx_t tx) {
+  if (trace_file == NULL) {
+    return;
+  }
+  assert(tx->id < SSTM_TRACE_THREADS);
+  tx->trace.events = TRACE_RING(tx->id);
+  tx->trace.head = &trace_file->slots[tx->id].head;
+  tx->trace.n = 0;
+}
+
+void sstm_trace_thread_stop(sstm_tx_t tx) {
+  tx->trace.events = NULL;
+}
+
+void sstm_trace_record(sstm_tx_t tx, int type, int arg, int aux, size_t stripe) {
+  sstm_trace_event_t* e = &tx->trace.events[tx->trace.n & (SSTM_TRACE_EVENTS - 1)];
+
+  e->ticks = getticks();
+  e->stripe = stripe;
+  e->aux = aux;
+  e->type = type;
+  e->arg = arg;
+  *tx->trace.head = ++tx->trace.n;
+}
@@ -0,0 +1,108 @@
+#include <sched.h>
+
+#include "sstm.h"
+
+/* Visible reads.
+ *
+ * A visible reader increments the reader count of every stripe it
+ * reads, then waits until no writer holds the stripe. A writer that
+ * locks a stripe checks its reader count afterwards, and aborts if the
+ * readers do not leave within SSTM_VISIBLE_DEFER pauses: between the
+ * increment and the lock, one of the two always sees the other. Nothing
+ * a visible reader has read can therefore change before it commits, so
+ * it neither validates nor aborts because of writers.
+ *
+ * A reader counts itself once per stripe (a bitmap per thread marks
+ * where) and keeps the stripes in its read set, without versions, to
+ * drop the counts at the end. Writers only look at the counts while some
+ * visible transaction runs (n_visible).
+ */
+
+void sstm_visible_begin(sstm_tx_t tx) {
+  sstm_visible_thread_t* v = &tx->visible;
+  size_t n = sstm_meta_global.n_nodes * tx->lock_table->size;
+
+  if (tx->mode != SSTM_MODE_OPTIMISTIC) { // another backend of the adaptive runtime
+    return;
+  }
+  if (v->n_marks < n) { // a first visible transaction, or a larger table
+    free(v->marks);
+    v->marks = calloc((n + 63) / 64, sizeof(uint64_t));
+    v->n_marks = n;
+  }
+  tx->mode = SSTM_MODE_VISIBLE;
+  IAF_U64(&sstm_meta_global.n_visible);
+}
+
+size_t sstm_visible_register(sstm_tx_t tx, volatile uintptr_t* addr) {
+  sstm_lock_table_t* table = tx->lock_table;
+  size_t stripe = sstm_stripe_in(table, addr);
+  uint64_t* mark = &tx->visible.marks[stripe / 64];
+  uint64_t bit = (uint64_t) 1 << (stripe % 64);
+  size_t pauses = 0;
+
+  // the writers already defer to us
+  if (*mark & bit) {
+    return 1;
+  }
+  *mark |= bit;
+  __sync_fetch_and_add(&table->readers[stripe], 1);
+  append_read_set(&tx->read_set, stripe, 0);
+
+  // the resizer waits for the readers it could not see: we wait for the
+  // next table
+  if (table->state != SSTM_TABLE_OPEN) {
+    tx->resize.blocked = 1;
+    sstm_tx_abort(tx, 13);
+    return 0;
+  }
+
+  // a writer that locked the stripe before it could see us either
+  // commits or aborts when it sees us
+  while (1) {
+    size_t lock = table->locks[stripe];
+    if (!LOCK_IS_LOCKED(lock)) {
+      return 1;
+    }
+    if (++pauses % SSTM_VISIBLE_YIELD == 0) {
+      sched_yield(); // the writer may not be running
+    } else {
+      PAUSE_IN();
+    }
+  }
+}
+
+uintptr_t sstm_visible_load(sstm_tx_t tx, volatile uintptr_t* addr) {
+  sstm_visible_register(tx, addr);
+  return *addr;
+}
+
+void sstm_visible_end(sstm_tx_t tx) {
+  read_set_t* rs = &tx->read_set;
+  size_t i;
+
+  for (i = 0; i < rs->size; i++) {
+    __sync_fetch_and_sub(&tx->lock_table->readers[rs->stripes[i]], 1);
+    tx->visible.marks[rs->stripes[i] / 64] = 0;
+  }
+  rs->size = 0;
+  __sync_fetch_and_sub(&sstm_meta_global.n_visible, 1);
+}
+
+void sstm_visible_thread_stop(sstm_tx_t tx) {
+  free(tx->visible.marks);
+  tx->visible.marks = NULL;
+  tx->visible.n_marks = 0;
+}
+
+size_t sstm_visible_defer(sstm_lock_table_t* table, size_t stripe) {
+  size_t pauses = 0;
+
+  while (table->readers[stripe] > 0) {
+    if (pauses++ == SSTM_VISIBLE_DEFER) {
+      return 0;
+    }
+    PAUSE_IN();
+  }
+  return 1;
+}
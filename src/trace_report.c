@@ -0,0 +1,504 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sstm_trace.h"
+
+/*
+ * Reads a trace written by a program run with SSTM_TRACE=<file> and
+ * reports who aborted whom: the per-thread outcomes, the conflict graph
+ * (victim -> owner of the stripe it conflicted on), the hottest stripes
+ * and the abort chains, where the owner that caused an abort aborts too.
+ */
+
+#define MAX_REASONS                     256
+#define TOP_STRIPES                     10
+#define TOP_CHAINS                      5
+#define MAX_CHAIN                       16
+
+static const char* names[SSTM_TRACE_TYPES] =
+  { "?", "begin", "load-conflict", "store-lock", "store-conflict", "validate", "commit", "abort" };
+
+typedef struct thread
+{
+  sstm_trace_event_t* ring;
+  uint64_t first;		/* index of its oldest event still in the ring */
+  uint64_t n;
+  uint64_t n_types[SSTM_TRACE_TYPES];
+  uint64_t n_reasons[MAX_REASONS];
+  uint64_t n_invalid;
+  uint64_t n_caused;		/* aborts with a conflict on a stripe of an owner */
+  size_t* ends;			/* its commits and aborts, in time order */
+  size_t n_ends;
+} thread_t;
+
+/* an abort, and the conflict that preceded it in the same attempt */
+typedef struct abort_rec
+{
+  uint64_t ticks;
+  uint64_t conflict_ticks;
+  uint32_t stripe;
+  uint16_t tid;
+  uint16_t owner;		/* 0 if unknown */
+  uint8_t reason;
+  long parent;			/* the abort of the owner it follows, -1 if none */
+  int depth;			/* aborts in its chain, itself included */
+} abort_rec_t;
+
+static sstm_trace_header_t* trace;
+static thread_t threads[SSTM_TRACE_THREADS];
+static uint64_t edges[SSTM_TRACE_THREADS][SSTM_TRACE_THREADS];
+static abort_rec_t* aborts;
+static size_t n_aborts;
+static uint64_t t0 = UINT64_MAX;
+
+static inline sstm_trace_event_t*
+event(thread_t* t, uint64_t i)
+{
+  return &t->ring[(t->first + i) & (trace->n_events - 1)];
+}
+
+static inline double
+us(uint64_t ticks)
+{
+  return (double) (ticks - t0) / trace->ticks_per_us;
+}
+
+/* the abort a commit or abort event ends, -1 for a commit */
+static long* end_abort;
+
+/* the first commit or abort of thread tid after ticks, or NULL */
+static size_t*
+next_end(int tid, uint64_t ticks)
+{
+  thread_t* t = &threads[tid];
+  size_t lo = 0, hi = t->n_ends;
+
+  while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if (event(t, t->ends[mid])->ticks < ticks)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo < t->n_ends ? &t->ends[lo] : NULL;
+}
+
+static int
+chain_depth(long a)
+{
+  int depth = 0;
+
+  /* with per-core clocks that drift, a chain could loop: cut it */
+  while (a >= 0 && depth < MAX_CHAIN)
+    {
+      if (aborts[a].depth > 0)
+	return depth + aborts[a].depth;
+      depth++;
+      a = aborts[a].parent;
+    }
+  return depth;
+}
+
+static int
+compare_u32(const void* a, const void* b)
+{
+  uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+  return (x > y) - (x < y);
+}
+
+static int
+compare_depth(const void* a, const void* b)
+{
+  return aborts[*(const size_t*) b].depth - aborts[*(const size_t*) a].depth;
+}
+
+typedef struct merged
+{
+  uint64_t ticks;
+  uint16_t tid;
+  sstm_trace_event_t* e;
+} merged_t;
+
+static int
+compare_ticks(const void* a, const void* b)
+{
+  uint64_t x = ((const merged_t*) a)->ticks, y = ((const merged_t*) b)->ticks;
+  return (x > y) - (x < y);
+}
+
+static void
+write_timeline(const char* path, uint64_t n_events)
+{
+  FILE* f = fopen(path, "w");
+  merged_t* all = malloc(n_events * sizeof(merged_t));
+  size_t n = 0, i;
+  int tid;
+
+  if (f == NULL || all == NULL)
+    {
+      perror(path);
+      exit(1);
+    }
+  for (tid = 0; tid < SSTM_TRACE_THREADS; tid++)
+    {
+      thread_t* t = &threads[tid];
+      for (i = 0; i < t->n; i++)
+	{
+	  all[n].e = event(t, i);
+	  all[n].ticks = all[n].e->ticks;
+	  all[n++].tid = tid;
+	}
+    }
+  qsort(all, n, sizeof(merged_t), compare_ticks);
+  fprintf(f, "us,thread,event,arg,aux,stripe\n");
+  for (i = 0; i < n; i++)
+    {
+      sstm_trace_event_t* e = all[i].e;
+      fprintf(f, "%.3f,%u,%s,%u,%u,%u\n", us(e->ticks), all[i].tid,
+	      e->type < SSTM_TRACE_TYPES ? names[e->type] : "?", e->arg, e->aux, e->stripe);
+    }
+  fclose(f);
+  free(all);
+}
+
+static void
+write_graph(const char* path)
+{
+  FILE* f = fopen(path, "w");
+  int v, o;
+  uint64_t max = 1;
+
+  if (f == NULL)
+    {
+      perror(path);
+      exit(1);
+    }
+  for (v = 0; v < SSTM_TRACE_THREADS; v++)
+    for (o = 0; o < SSTM_TRACE_THREADS; o++)
+      if (edges[v][o] > max)
+	max = edges[v][o];
+  fprintf(f, "digraph conflicts {\n");
+  for (v = 0; v < SSTM_TRACE_THREADS; v++)
+    if (threads[v].n > 0)
+      fprintf(f, "  t%d [label=\"%d\\n%lu commits\"];\n", v, v,
+	      (unsigned long) threads[v].n_types[SSTM_TRACE_COMMIT]);
+  for (v = 0; v < SSTM_TRACE_THREADS; v++)
+    for (o = 0; o < SSTM_TRACE_THREADS; o++)
+      if (edges[v][o] > 0)
+	fprintf(f, "  t%d -> t%d [label=%lu, penwidth=%.1f];\n", v, o,
+		(unsigned long) edges[v][o], 1 + 4.0 * edges[v][o] / max);
+  fprintf(f, "}\n");
+  fclose(f);
+}
+
+static void
+usage(const char* prog)
+{
+  printf("Conflict report of an sstm event trace\n");
+  printf("\n");
+  printf("Usage:\n");
+  printf("  %s [options...] <trace>\n", prog);
+  printf("\n");
+  printf("Options:\n");
+  printf("  -h, --help\n");
+  printf("        Print this message\n");
+  printf("  -g, --graph <file>\n");
+  printf("        Write the conflict graph in dot format\n");
+  printf("  -t, --timeline <file>\n");
+  printf("        Write all the events in time order, as csv\n");
+}
+
+int
+main(int argc, char** argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"graph",                     required_argument, NULL, 'g'},
+    {"timeline",                  required_argument, NULL, 't'},
+    {NULL, 0, NULL, 0}
+  };
+  char* graph = NULL;
+  char* timeline = NULL;
+  struct stat st;
+  uint64_t n_events = 0, n_unknown = 0;
+  uint32_t* stripes;
+  size_t n_stripes = 0, i;
+  long* current;
+  uint64_t t_end = 0;
+  int c, tid, v, o;
+
+  while (1)
+    {
+      int option_index = 0;
+      c = getopt_long(argc, argv, "hg:t:", long_options, &option_index);
+      if (c == -1)
+	break;
+      switch (c)
+	{
+	case 'h':
+	  usage(argv[0]);
+	  exit(0);
+	case 'g':
+	  graph = optarg;
+	  break;
+	case 't':
+	  timeline = optarg;
+	  break;
+	default:
+	  usage(argv[0]);
+	  exit(1);
+	}
+    }
+  if (optind != argc - 1)
+    {
+      usage(argv[0]);
+      exit(1);
+    }
+
+  int fd = open(argv[optind], O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(sstm_trace_header_t))
+    {
+      perror(argv[optind]);
+      exit(1);
+    }
+  trace = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  assert(trace != MAP_FAILED);
+  close(fd);
+  if (trace->magic != SSTM_TRACE_MAGIC || trace->n_slots > SSTM_TRACE_THREADS
+      || sizeof(sstm_trace_header_t) + trace->n_slots * trace->n_events * sizeof(sstm_trace_event_t) > (size_t) st.st_size)
+    {
+      fprintf(stderr, "%s: not a trace\n", argv[optind]);
+      exit(1);
+    }
+
+  /* the rings, and the ordinal of each commit or abort */
+  for (tid = 0; tid < (int) trace->n_slots; tid++)
+    {
+      thread_t* t = &threads[tid];
+      uint64_t head = trace->slots[tid].head;
+      t->ring = (sstm_trace_event_t*) (trace + 1) + tid * trace->n_events;
+      t->n = head < trace->n_events ? head : trace->n_events;
+      t->first = head - t->n;
+      t->ends = malloc((t->n + 1) * sizeof(size_t));
+      for (i = 0; i < t->n; i++)
+	{
+	  sstm_trace_event_t* e = event(t, i);
+	  if (e->ticks < t0)
+	    t0 = e->ticks;
+	  if (e->ticks > t_end)
+	    t_end = e->ticks;
+	  if (e->type == SSTM_TRACE_COMMIT || e->type == SSTM_TRACE_ABORT)
+	    t->ends[t->n_ends++] = i;
+	}
+      n_events += t->n;
+    }
+  if (n_events == 0)
+    {
+      printf("No events\n");
+      exit(0);
+    }
+
+  /* the aborts, with the last conflict of their attempt */
+  current = malloc(SSTM_TRACE_THREADS * sizeof(long));
+  aborts = malloc(n_events * sizeof(abort_rec_t));
+  stripes = malloc(n_events * sizeof(uint32_t));
+  for (tid = 0; tid < (int) trace->n_slots; tid++)
+    {
+      thread_t* t = &threads[tid];
+      sstm_trace_event_t* conflict = NULL;
+      for (i = 0; i < t->n; i++)
+	{
+	  sstm_trace_event_t* e = event(t, i);
+	  if (e->type >= SSTM_TRACE_TYPES)
+	    continue;
+	  t->n_types[e->type]++;
+	  switch (e->type)
+	    {
+	    case SSTM_TRACE_BEGIN:
+	      conflict = NULL;
+	      break;
+	    case SSTM_TRACE_LOAD_CONFLICT:
+	    case SSTM_TRACE_STORE_CONFLICT:
+	      conflict = e;
+	      break;
+	    case SSTM_TRACE_VALIDATE:
+	      if (!e->arg)
+		t->n_invalid++;
+	      break;
+	    case SSTM_TRACE_ABORT:
+	      {
+		abort_rec_t* a = &aborts[n_aborts++];
+		t->n_reasons[e->arg]++;
+		a->ticks = e->ticks;
+		a->tid = tid;
+		a->reason = e->arg;
+		a->owner = conflict != NULL ? conflict->aux : 0;
+		a->stripe = conflict != NULL ? conflict->stripe : 0;
+		a->conflict_ticks = conflict != NULL ? conflict->ticks : e->ticks;
+		a->parent = -1;
+		a->depth = 0;
+		if (a->owner != 0 && a->owner != tid && a->owner < trace->n_slots)
+		  {
+		    t->n_caused++;
+		    edges[tid][a->owner]++;
+		    stripes[n_stripes++] = a->stripe;
+		  }
+		else
+		  {
+		    a->owner = 0;
+		    n_unknown++;
+		  }
+		/* an abort restarts without a begin event of its own */
+		conflict = NULL;
+	      }
+	      break;
+	    }
+	}
+    }
+
+  /* which abort each commit or abort event is, per thread */
+  end_abort = malloc(n_events * sizeof(long));
+  {
+    size_t base = 0, k = 0;
+    for (tid = 0; tid < (int) trace->n_slots; tid++)
+      {
+	thread_t* t = &threads[tid];
+	size_t* ends = t->ends;
+	for (i = 0; i < t->n_ends; i++)
+	  {
+	    if (event(t, ends[i])->type == SSTM_TRACE_ABORT)
+	      end_abort[base + i] = k++;
+	    else
+	      end_abort[base + i] = -1;
+	  }
+	current[tid] = base;
+	base += t->n_ends;
+      }
+  }
+
+  /* the owner of the stripe aborted afterwards, instead of committing */
+  for (i = 0; i < n_aborts; i++)
+    {
+      abort_rec_t* a = &aborts[i];
+      size_t* end;
+      if (a->owner == 0 || (end = next_end(a->owner, a->conflict_ticks)) == NULL)
+	continue;
+      a->parent = end_abort[current[a->owner] + (end - threads[a->owner].ends)];
+    }
+  for (i = 0; i < n_aborts; i++)
+    aborts[i].depth = chain_depth(i);
+
+  /* per thread */
+  printf("#### %lu events, %lu ticks/us, %.3f ms\n", (unsigned long) n_events,
+	 (unsigned long) trace->ticks_per_us, us(t_end) / 1000);
+  printf("%-7s %-10s %-10s %-10s %-10s %-10s %s\n", "thread", "commits", "aborts", "load-cfl", "store-cfl", "invalid",
+	 "reasons");
+  for (tid = 0; tid < (int) trace->n_slots; tid++)
+    {
+      thread_t* t = &threads[tid];
+      int r;
+      if (t->n == 0)
+	continue;
+      printf("%-7d %-10lu %-10lu %-10lu %-10lu %-10lu", tid, (unsigned long) t->n_types[SSTM_TRACE_COMMIT],
+	     (unsigned long) t->n_types[SSTM_TRACE_ABORT], (unsigned long) t->n_types[SSTM_TRACE_LOAD_CONFLICT],
+	     (unsigned long) t->n_types[SSTM_TRACE_STORE_CONFLICT], (unsigned long) t->n_invalid);
+      for (r = 0; r < MAX_REASONS; r++)
+	if (t->n_reasons[r] > 0)
+	  printf(" %d:%lu", r, (unsigned long) t->n_reasons[r]);
+      printf("\n");
+    }
+
+  /* conflict graph */
+  printf("#### Conflicts: victim -> owner (%lu aborts without an owner)\n", (unsigned long) n_unknown);
+  for (v = 0; v < SSTM_TRACE_THREADS; v++)
+    for (o = 0; o < SSTM_TRACE_THREADS; o++)
+      if (edges[v][o] > 0)
+	printf("%3d -> %-3d %lu\n", v, o, (unsigned long) edges[v][o]);
+
+  /* hottest stripes */
+  if (n_stripes > 0)
+    {
+      uint32_t top[TOP_STRIPES], top_n[TOP_STRIPES];
+      size_t n_top = 0, run, k;
+      qsort(stripes, n_stripes, sizeof(uint32_t), compare_u32);
+      for (i = 0; i < n_stripes; i += run)
+	{
+	  for (run = 1; i + run < n_stripes && stripes[i + run] == stripes[i]; run++)
+	    ;
+	  for (k = n_top; k > 0 && top_n[k - 1] < run; k--)
+	    if (k < TOP_STRIPES)
+	      {
+		top[k] = top[k - 1];
+		top_n[k] = top_n[k - 1];
+	      }
+	  if (k < TOP_STRIPES)
+	    {
+	      top[k] = stripes[i];
+	      top_n[k] = run;
+	      if (n_top < TOP_STRIPES)
+		n_top++;
+	    }
+	}
+      printf("#### Stripes: stripe aborts\n");
+      for (k = 0; k < n_top; k++)
+	printf("%-10u %u\n", top[k], top_n[k]);
+    }
+
+  /* abort chains */
+  if (n_aborts > 0)
+    {
+      uint64_t lengths[MAX_CHAIN + 1] = { 0 };
+      size_t* order = malloc(n_aborts * sizeof(size_t));
+      size_t printed[TOP_CHAINS], k;
+      int d;
+      for (i = 0; i < n_aborts; i++)
+	{
+	  lengths[aborts[i].depth]++;
+	  order[i] = i;
+	}
+      printf("#### Abort chains: length aborts\n");
+      for (d = 1; d <= MAX_CHAIN; d++)
+	if (lengths[d] > 0)
+	  printf("%s%-9d %lu\n", d == MAX_CHAIN ? ">=" : "", d, (unsigned long) lengths[d]);
+      qsort(order, n_aborts, sizeof(size_t), compare_depth);
+      for (i = 0, k = 0; k < TOP_CHAINS && i < n_aborts && aborts[order[i]].depth > 1; i++)
+	{
+	  long a = order[i];
+	  size_t j;
+	  /* the victims of one abort share the rest of its chain */
+	  for (j = 0; j < k && aborts[printed[j]].parent != aborts[a].parent; j++)
+	    ;
+	  if (j < k)
+	    continue;
+	  printed[k++] = a;
+	  printf("## chain of %d\n", aborts[a].depth);
+	  for (d = 0; a >= 0 && d < MAX_CHAIN; d++, a = aborts[a].parent)
+	    printf("%12.3f us  thread %-3u aborted (%u) on stripe %-10u held by %u\n", us(aborts[a].ticks),
+		   aborts[a].tid, aborts[a].reason, aborts[a].stripe, aborts[a].owner);
+	}
+      free(order);
+    }
+
+  if (graph != NULL)
+    write_graph(graph);
+  if (timeline != NULL)
+    write_timeline(timeline, n_events);
+
+  free(aborts);
+  free(stripes);
+  free(end_abort);
+  free(current);
+  for (tid = 0; tid < SSTM_TRACE_THREADS; tid++)
+    free(threads[tid].ends);
+  munmap(trace, st.st_size);
+  return 0;
+}
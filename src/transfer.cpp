@@ -0,0 +1,306 @@
+#include <assert.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <optional>
+#include <vector>
+
+#include "sstm.hpp"
+#include "random.h"
+__thread unsigned long* seeds;
+
+/*
+ * The bank transfers of bank.c through the C++ layer (sstm.hpp): every
+ * policy is exercised, transfers either commit or abort as a whole, and
+ * the accounts must always sum to 0. Some transfers are cancelled halfway
+ * on purpose, to check that a cancelled transaction leaves no write
+ * behind, including on the global-lock backend that writes in place (-x). With -B, the main thread
+ * takes online snapshots of the accounts meanwhile, and each must sum to 0.
+ */
+
+#define DEFAULT_DURATION                1
+#define DEFAULT_NB_ACCOUNTS             1024
+#define DEFAULT_NB_THREADS              4
+#define DEFAULT_MVCC                    0
+#define DEFAULT_ADAPTIVE                0
+#define DEFAULT_SNAPSHOTS               0
+#define CANCEL_EVERY                    64
+
+int duration = DEFAULT_DURATION;
+int nb_accounts = DEFAULT_NB_ACCOUNTS;
+int mvcc = DEFAULT_MVCC;
+int adaptive = DEFAULT_ADAPTIVE;
+int snapshots = DEFAULT_SNAPSHOTS;
+
+volatile int work;
+std::vector<sstm::tm_var<int64_t>>* accounts;
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+struct thread_data
+{
+  size_t transfers;
+  size_t cancels;
+  size_t checks;
+  size_t wrong;
+};
+
+template <typename Policy>
+static sstm::status
+transfer(Policy policy, size_t src, size_t dst, int64_t amount, bool bounce)
+{
+  return sstm::atomically(policy, [&](auto& tx) {
+      std::vector<sstm::tm_var<int64_t>>& a = *accounts;
+      std::optional<int64_t> s = tx.load(a[src]);
+      if (!s || !tx.store(a[src], *s - amount))
+	{
+	  return sstm::status::aborted;
+	}
+      if (bounce)
+	{
+	  return sstm::status::cancel;
+	}
+      std::optional<int64_t> d = tx.load(a[dst]);
+      if (!d || !tx.store(a[dst], *d + amount))
+	{
+	  return sstm::status::aborted;
+	}
+      return sstm::status::commit;
+    });
+}
+
+template <typename Policy>
+static int64_t
+total(Policy policy)
+{
+  int64_t sum;
+  sstm::atomically(policy, [&](auto& tx) {
+      sum = 0;
+      for (auto& account : *accounts)
+	{
+	  std::optional<int64_t> v = tx.load(account);
+	  if (!v)
+	    {
+	      return sstm::status::aborted;
+	    }
+	  sum += *v;
+	}
+      return sstm::status::commit;
+    });
+  return sum;
+}
+
+static void*
+test(void* arg)
+{
+  thread_data* d = (thread_data*) arg;
+  seed_rand();
+  TM_THREAD_START();
+
+  while (work)
+    {
+      size_t src = fast_rand() % nb_accounts, dst = fast_rand() % nb_accounts;
+      bool bounce = fast_rand() % CANCEL_EVERY == 0;
+      sstm::status s;
+      switch (fast_rand() % 4)
+	{
+	case 0:
+	  s = transfer(sstm::eager_policy(), src, dst, 1, bounce);
+	  break;
+	case 1:
+	  s = transfer(sstm::lazy_policy(), src, dst, 1, bounce);
+	  break;
+	case 2:
+	  if (mvcc)
+	    {
+	      s = transfer(sstm::si_policy(), src, dst, 1, bounce);
+	    }
+	  else
+	    {
+	      s = transfer(sstm::eager_policy(), src, dst, 1, bounce);
+	    }
+	  break;
+	default:
+	  int64_t sum = mvcc ? total(sstm::snapshot_policy()) : total(sstm::read_only_policy());
+	  d->checks++;
+	  d->wrong += sum != 0;
+	  continue;
+	}
+      if (s == sstm::status::cancel)
+	{
+	  d->cancels++;
+	}
+      else
+	{
+	  d->transfers++;
+	}
+    }
+
+  TM_THREAD_STOP();
+  free_rand();
+  return NULL;
+}
+
+int
+main(int argc, char** argv)
+{
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help", no_argument, NULL, 'h'},
+      {"duration", required_argument, NULL, 'd'},
+      {"num-accounts", required_argument, NULL, 'a'},
+      {"num-threads", required_argument, NULL, 'n'},
+      {"mvcc", no_argument, NULL, 'm'},
+      {"adaptive", no_argument, NULL, 'x'},
+      {"snapshots", no_argument, NULL, 'B'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int num_threads = DEFAULT_NB_THREADS;
+  int i, c;
+  while (1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hd:a:n:mxB", long_options, &i);
+
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'h':
+	  printf("transfer -- bank transfers through the C++ interface\n"
+		 "\n"
+		 "Usage:\n"
+		 "  transfer [options...]\n"
+		 "\n"
+		 "Options:\n"
+		 "  -h, --help\n"
+		 "        Print this message\n"
+		 "  -d, --duration <int>\n"
+		 "        Test duration in seconds (default=" XSTR(DEFAULT_DURATION) ")\n"
+		 "  -a, --num-accounts <int>\n"
+		 "        Number of accounts (default=" XSTR(DEFAULT_NB_ACCOUNTS) ")\n"
+		 "  -n, --num-threads <int>\n"
+		 "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+		 "  -m, --mvcc\n"
+		 "        Snapshot-isolation transfers and snapshot totals (default=" XSTR(DEFAULT_MVCC) ")\n"
+		 "  -x, --adaptive\n"
+		 "        Adaptive runtime, starting on the global-lock backend (default=" XSTR(DEFAULT_ADAPTIVE) ")\n"
+		 "  -B, --snapshots\n"
+		 "        Check online snapshots of the accounts during the run (default=" XSTR(DEFAULT_SNAPSHOTS) ")\n"
+		 );
+	  exit(0);
+	case 'd':
+	  duration = atoi(optarg);
+	  break;
+	case 'a':
+	  nb_accounts = atoi(optarg);
+	  break;
+	case 'n':
+	  num_threads = atoi(optarg);
+	  break;
+	case 'm':
+	  mvcc = 1;
+	  break;
+	case 'x':
+	  adaptive = 1;
+	  break;
+	case 'B':
+	  snapshots = 1;
+	  break;
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  assert(duration > 0 && nb_accounts >= 2 && num_threads >= 1);
+  assert(!mvcc || !adaptive);
+  assert(!snapshots || !adaptive);
+
+  accounts = new std::vector<sstm::tm_var<int64_t>>(nb_accounts);
+  TM_START();
+  if (mvcc)
+    {
+      sstm_mv_enable();
+    }
+  else if (adaptive)
+    {
+      sstm_adapt_enable(SSTM_BACKEND_GLOBAL_LOCK);
+    }
+  if (snapshots)
+    {
+      sstm_snapshot_region(accounts->data(), nb_accounts * sizeof (sstm::tm_var<int64_t>));
+    }
+
+  std::vector<thread_data> data(num_threads);
+  std::vector<pthread_t> threads(num_threads);
+  work = 1;
+  for (i = 0; i < num_threads; i++)
+    {
+      if (pthread_create(&threads[i], NULL, test, &data[i]))
+	{
+	  printf("ERROR; pthread_create()\n");
+	  exit(-1);
+	}
+    }
+  size_t nb_snapshots = 0, snapshots_wrong = 0;
+  if (snapshots)
+    {
+      // copies of the accounts while the transfers run
+      std::vector<sstm::tm_var<int64_t>> copy(nb_accounts);
+      time_t end = time(NULL) + duration;
+      while (time(NULL) < end)
+	{
+	  sstm_snapshot_take(copy.data());
+	  int64_t sum = 0;
+	  for (auto& account : copy)
+	    {
+	      sum += account.unsafe_load();
+	    }
+	  nb_snapshots++;
+	  snapshots_wrong += sum != 0;
+	}
+    }
+  else
+    {
+      sleep(duration);
+    }
+  work = 0;
+
+  thread_data all = { 0, 0, 0, 0 };
+  for (i = 0; i < num_threads; i++)
+    {
+      pthread_join(threads[i], NULL);
+      all.transfers += data[i].transfers;
+      all.cancels += data[i].cancels;
+      all.checks += data[i].checks;
+      all.wrong += data[i].wrong;
+    }
+
+  int64_t sum = 0;
+  for (auto& account : *accounts)
+    {
+      sum += account.unsafe_load();
+    }
+
+  printf("# Transfers: %zu, cancelled: %zu, totals: %zu (%zu wrong)\n", all.transfers, all.cancels, all.checks, all.wrong);
+  if (snapshots)
+    {
+      printf("# Snapshots: %zu (%zu wrong)\n", nb_snapshots, snapshots_wrong);
+    }
+  printf("Bank total  (after): %ld%s\n", (long) sum, sum != 0 || all.wrong || snapshots_wrong ? " wrong" : "");
+  TM_STATS(duration);
+  sstm_adapt_print_stats();
+  TM_STOP();
+  delete accounts;
+  return sum != 0 || all.wrong || snapshots_wrong;
+}